@@ -14,201 +14,6279 @@
 // -----------------------------------------------------------------------------
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ABCU_HAVE_MMAP 1
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define ABCU_HAVE_EPOLL 1
+#endif
+
+#ifdef ABCU_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ABCU_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 using namespace std;
 
 // -----------------------------------------------------------------------------
-// Data Model
+// Instrumentation (--stats, GET /metrics)
+// -----------------------------------------------------------------------------
+// Phase timers, latency histograms and allocation/byte counters. On by
+// default; release builds (-DNDEBUG) or -DABCU_METRICS=0 compile every hook
+// below to nothing, including the operator new replacement.
+#ifndef ABCU_METRICS
+#ifdef NDEBUG
+#define ABCU_METRICS 0
+#else
+#define ABCU_METRICS 1
+#endif
+#endif
+
+#if ABCU_METRICS
+enum class Phase { Read, Parse, Split, Normalize, Insert, Merge, Sort, Graph, Search, Validate, Reload, Count };
+static const char* const kPhaseNames[] = {"read",  "parse", "split",  "normalize", "insert", "merge",
+                                          "sort",  "graph", "search", "validate",  "reload"};
+// Split, normalize and insert are timed on one line in kSampleEvery and
+// scaled up, which keeps two clock reads per field off most lines.
+static const uint32_t kSampleEvery = 16;
+
+// Log-linear histogram of nanosecond values in the HDR style: 8 sub-buckets
+// per power of two, so any recorded value is off by at most 12.5%. Lock
+// free; recording is one relaxed increment.
+class LatencyHistogram {
+public:
+    static const size_t kBuckets = 16 + 60 * 8;
+
+    void record(uint64_t ns) {
+        counts_[bucketOf(ns)].fetch_add(1, memory_order_relaxed);
+        sum_.fetch_add(ns, memory_order_relaxed);
+    }
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (const auto& c : counts_) n += c.load(memory_order_relaxed);
+        return n;
+    }
+    uint64_t sum() const { return sum_.load(memory_order_relaxed); }
+    uint64_t bucketCount(size_t i) const { return counts_[i].load(memory_order_relaxed); }
+
+    // Upper bound of bucket i, in ns.
+    static uint64_t bucketLimit(size_t i) {
+        if (i < 16) return i + 1;
+        unsigned e = (unsigned)(i - 16) / 8 + 4, sub = (unsigned)(i - 16) % 8;
+        return (uint64_t)(9 + sub) << (e - 3);
+    }
+    // Value below which fraction q of the recordings fall.
+    uint64_t quantile(double q) const {
+        uint64_t total = count(), seen = 0;
+        if (total == 0) return 0;
+        uint64_t rank = (uint64_t)(q * (double)(total - 1)) + 1;
+        for (size_t i = 0; i < kBuckets; ++i)
+            if ((seen += bucketCount(i)) >= rank) return bucketLimit(i);
+        return bucketLimit(kBuckets - 1);
+    }
+
+private:
+    static unsigned highestBit(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - (unsigned)__builtin_clzll(v);
+#else
+        unsigned e = 0;
+        while (v >>= 1) ++e;
+        return e;
+#endif
+    }
+    static size_t bucketOf(uint64_t v) {
+        if (v < 16) return (size_t)v;
+        unsigned e = highestBit(v);
+        return 16 + (e - 4) * 8 + (size_t)((v >> (e - 3)) & 7);
+    }
+
+    atomic<uint64_t> counts_[kBuckets] = {};
+    atomic<uint64_t> sum_{0};
+};
+
+struct Metrics {
+    atomic<uint64_t> phaseNs[(size_t)Phase::Count] = {};
+    atomic<uint64_t> phaseCalls[(size_t)Phase::Count] = {};
+    LatencyHistogram courseLookup, prereqLookup, dependentsLookup, search;
+    atomic<uint64_t> bytesRead{0}, bytesWritten{0};
+    atomic<uint64_t> allocations{0}, allocatedBytes{0}, frees{0};
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> renderHits{0}, renderMisses{0};
+
+    void addPhase(Phase p, uint64_t ns, uint64_t calls = 1) {
+        phaseNs[(size_t)p].fetch_add(ns, memory_order_relaxed);
+        phaseCalls[(size_t)p].fetch_add(calls, memory_order_relaxed);
+    }
+};
+
+// Constant-initialized, so it is usable from operator new before main.
+static Metrics gMetrics;
+static inline Metrics& metrics() { return gMetrics; }
+
+static inline uint64_t nowNs() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase p) : phase_(p), start_(nowNs()) {}
+    ~PhaseTimer() { metrics().addPhase(phase_, nowNs() - start_); }
+
+private:
+    Phase phase_;
+    uint64_t start_;
+};
+
+class LatencyTimer {
+public:
+    explicit LatencyTimer(LatencyHistogram& h) : hist_(h), start_(nowNs()) {}
+    ~LatencyTimer() { hist_.record(nowNs() - start_); }
+
+private:
+    LatencyHistogram& hist_;
+    uint64_t start_;
+};
+
+// Per-parser sampled phase times (see kSampleEvery); merged into metrics()
+// once the parse is done, so parser threads never share a counter.
+struct PhaseSampler {
+    uint64_t ns[(size_t)Phase::Count] = {};
+    uint32_t tick = 0;
+    bool active = false;
+    uint64_t last = 0;
+
+    void beginLine() {
+        active = tick++ % kSampleEvery == 0;
+        if (active) last = nowNs();
+    }
+    void lap(Phase p) {
+        if (!active) return;
+        uint64_t t = nowNs();
+        ns[(size_t)p] += t - last;
+        last = t;
+    }
+    void mergeInto(PhaseSampler& o) const {
+        for (size_t i = 0; i < (size_t)Phase::Count; ++i) o.ns[i] += ns[i];
+        o.tick += tick;
+    }
+    void publish() const {
+        for (Phase p : {Phase::Split, Phase::Normalize, Phase::Insert})
+            if (ns[(size_t)p]) metrics().addPhase(p, ns[(size_t)p] * kSampleEvery, tick);
+    }
+};
+
+// Counts every heap allocation in the program. Aligned and array forms
+// funnel into these by default.
+void* operator new(size_t n) {
+    gMetrics.allocations.fetch_add(1, memory_order_relaxed);
+    gMetrics.allocatedBytes.fetch_add(n, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+// GCC pairs the inlined malloc with this free and warns about a mismatch it
+// introduced itself.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    if (p) gMetrics.frees.fetch_add(1, memory_order_relaxed);
+    free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+#define ABCU_CONCAT2(a, b) a##b
+#define ABCU_CONCAT(a, b) ABCU_CONCAT2(a, b)
+#define ABCU_TIME_PHASE(p) PhaseTimer ABCU_CONCAT(phaseTimer_, __LINE__)(Phase::p)
+#define ABCU_TIME_LATENCY(h) LatencyTimer ABCU_CONCAT(latencyTimer_, __LINE__)(metrics().h)
+#define ABCU_COUNT(counter, n) metrics().counter.fetch_add((uint64_t)(n), memory_order_relaxed)
+#define ABCU_SAMPLE_BEGIN(sampler) (sampler).beginLine()
+#define ABCU_SAMPLE_LAP(sampler, p) (sampler).lap(Phase::p)
+#else
+#define ABCU_TIME_PHASE(p) ((void)0)
+#define ABCU_TIME_LATENCY(h) ((void)0)
+#define ABCU_COUNT(counter, n) ((void)0)
+#define ABCU_SAMPLE_BEGIN(sampler) ((void)0)
+#define ABCU_SAMPLE_LAP(sampler, p) ((void)0)
+#endif
+
+
+// -----------------------------------------------------------------------------
+// Data Model
+// -----------------------------------------------------------------------------
+// Course IDs are interned: every distinct normalized code (including ones
+// that only appear as a prerequisite) gets a dense 32-bit CourseId, and all
+// strings live in one arena owned by the table.
+using CourseId = uint32_t;
+static const CourseId kNoCourse = UINT32_MAX;
+
+// Minimal read-only view over a contiguous array.
+template <typename T>
+struct Span {
+    const T* ptr = nullptr;
+    size_t len = 0;
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + len; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+};
+
+// Array of trivially copyable elements that either owns its storage or
+// borrows read-only memory (e.g. a mapped snapshot). Reads always go through
+// one pointer; the first mutation of a borrowed array copies it.
+template <typename T>
+class PodArray {
+public:
+    PodArray() = default;
+    PodArray(const PodArray&) = delete;
+    PodArray& operator=(const PodArray&) = delete;
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* data() const { return data_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    Span<T> span() const { return {data_, size_}; }
+    bool borrowed() const { return borrowed_; }
+
+    T& at(size_t i) { own(); return owned_[i]; }
+    void push_back(const T& v) { own(); owned_.push_back(v); sync(); }
+    void append(const T* p, size_t n) { own(); owned_.insert(owned_.end(), p, p + n); sync(); }
+    void assign(size_t n, const T& v) { borrowed_ = false; owned_.assign(n, v); sync(); }
+    void adopt(vector<T>&& v) { borrowed_ = false; owned_ = std::move(v); sync(); }
+    void reserve(size_t n) { own(); owned_.reserve(n); sync(); }
+    void clear() { borrowed_ = false; owned_.clear(); sync(); }
+    void shrinkToFit() { if (!borrowed_) { owned_.shrink_to_fit(); sync(); } }
+
+    // Copies owned contents; a borrowed array keeps borrowing the same memory.
+    void copyFrom(const PodArray& o) {
+        if (o.borrowed_) borrow(o.data_, o.size_);
+        else adopt(vector<T>(o.owned_));
+    }
+
+    // `p` must stay valid (and unchanged) for as long as this array uses it.
+    void borrow(const T* p, size_t n) {
+        vector<T>().swap(owned_);
+        borrowed_ = true;
+        data_ = p;
+        size_ = n;
+    }
+
+    // Heap bytes held; borrowed memory is not counted.
+    size_t bytes() const { return owned_.capacity() * sizeof(T); }
+
+    void swap(PodArray& o) {
+        owned_.swap(o.owned_);
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+        std::swap(borrowed_, o.borrowed_);
+    }
+
+private:
+    void own() {
+        if (borrowed_) {
+            owned_.assign(data_, data_ + size_);
+            borrowed_ = false;
+            sync();
+        }
+    }
+    void sync() {
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+
+    vector<T> owned_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+    bool borrowed_ = false;
+};
+
+// Location of a string inside a StringArena. Offsets rather than pointers,
+// so references stay valid while the arena grows.
+struct StrRef {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+// Bump allocator for course codes and titles: strings are appended back to
+// back and never freed individually.
+class StringArena {
+public:
+    StrRef append(string_view s) {
+        if (buf_.size() + s.size() > UINT32_MAX) throw length_error("course string arena exceeds 4 GiB");
+        StrRef r{(uint32_t)buf_.size(), (uint32_t)s.size()};
+        buf_.append(s.data(), s.size());
+        return r;
+    }
+    string_view view(StrRef r) const { return string_view(buf_.data() + r.offset, r.length); }
+    void reserve(size_t n) { buf_.reserve(min<size_t>(n, UINT32_MAX)); }
+    void shrinkToFit() { buf_.shrinkToFit(); }
+    size_t bytes() const { return buf_.bytes(); }
+    void swap(StringArena& o) { buf_.swap(o.buf_); }
+    void copyFrom(const StringArena& o) { buf_.copyFrom(o.buf_); }
+
+    PodArray<char>& storage() { return buf_; }
+    const PodArray<char>& storage() const { return buf_; }
+
+private:
+    PodArray<char> buf_;
+};
+
+struct Course {
+    StrRef number;             // normalized course code (e.g. "CSCI200")
+    StrRef title;              // descriptive course name
+    uint32_t prereqBegin = 0;  // first prerequisite in CourseTable's pool
+    uint32_t prereqCount = 0;
+    bool defined = false;      // false if the code was only seen as a prerequisite
+    uint8_t pad[3] = {};       // explicit so snapshot bytes are deterministic
+};
+static_assert(sizeof(Course) == 28, "Course is stored as-is in snapshots");
+
+static inline uint32_t hashCourseId(string_view s) {
+    // FNV-1a plus a final avalanche so the low 7 bits (the Swiss-table tag)
+    // depend on every character; course codes are short, nothing fancier needed
+    uint32_t h = 2166136261u;
+    for (char ch : s) h = (h ^ (unsigned char)ch) * 16777619u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// Packs normalized codes of the usual shape, one to Letters capitals then
+// one to Digits digits ("CSCI200"), into a 64-bit key: 5 bits per letter
+// (A = 1) and 4 per digit ('0' = 1), each field left-aligned and padded with
+// zeros. A zero pad sorts below any character just as the end of a string
+// does, and digits sort below letters, so comparing keys agrees with
+// comparing codes bytewise. Codes of any other shape pack to 0 and are
+// handled as strings. -DABCU_CODE_LETTERS / -DABCU_CODE_DIGITS set the shape.
+template <unsigned Letters, unsigned Digits>
+struct PackedCodeFormat {
+    static_assert(Letters >= 1 && Digits >= 1 && Letters * 5 + Digits * 4 <= 64, "code shape does not fit 64 bits");
+    // Recorded in snapshots, whose index holds keys of this format.
+    static constexpr uint32_t kTag = Letters << 8 | Digits;
+
+    static constexpr uint64_t pack(string_view code) {
+        size_t n = code.size(), i = 0;
+        if (n < 2 || n > Letters + Digits) return 0;
+        uint64_t key = 0;
+        for (; i < n && i < Letters && (unsigned)(code[i] - 'A') < 26; ++i)
+            key = key << 5 | (uint64_t)(code[i] - 'A' + 1);
+        size_t letters = i;
+        key <<= 5 * (Letters - letters);
+        for (; i < n && (unsigned)(code[i] - '0') < 10; ++i) key = key << 4 | (uint64_t)(code[i] - '0' + 1);
+        size_t digits = i - letters;
+        if (letters == 0 || digits == 0 || digits > Digits || i != n) return 0;
+        return key << 4 * (Digits - digits);
+    }
+};
+
+#ifndef ABCU_CODE_LETTERS
+#define ABCU_CODE_LETTERS 4
+#endif
+#ifndef ABCU_CODE_DIGITS
+#define ABCU_CODE_DIGITS 4
+#endif
+using CodeFormat = PackedCodeFormat<ABCU_CODE_LETTERS, ABCU_CODE_DIGITS>;
+
+static_assert(PackedCodeFormat<4, 4>::pack("CS200") < PackedCodeFormat<4, 4>::pack("CSC100") &&
+                  PackedCodeFormat<4, 4>::pack("CSCI20") < PackedCodeFormat<4, 4>::pack("CSCI200") &&
+                  PackedCodeFormat<4, 4>::pack("CSCI200") < PackedCodeFormat<4, 4>::pack("CSCI30"),
+              "packed keys must sort like the codes");
+
+// What the course index hashes and compares per code: the packed key (0 if
+// the code does not pack) and a 32-bit hash.
+struct CodeKey {
+    uint64_t packed;
+    uint32_t hash;
+};
+
+static inline CodeKey courseKey(string_view s) {
+    if (uint64_t k = CodeFormat::pack(s)) return {k, (uint32_t)((k * 0x9E3779B97F4A7C15ull) >> 32)};
+    return {0, hashCourseId(s)};
+}
+
+static inline unsigned popCount(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_popcountll(x);
+#else
+    unsigned n = 0;
+    for (; x; x &= x - 1) ++n;
+    return n;
+#endif
+}
+
+static inline unsigned countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while (!(x & 1)) { x >>= 1; ++n; }
+    return n;
+#endif
+}
+
+// `x` must be nonzero.
+static inline unsigned countLeadingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_clzll(x);
+#else
+    unsigned n = 0;
+    while (!(x >> 63)) { x <<= 1; ++n; }
+    return n;
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Course index: normalized code -> CourseId
+// -----------------------------------------------------------------------------
+// Two interchangeable layouts, chosen at compile time so they can be
+// benchmarked against each other. Build with -DABCU_STD_COURSE_INDEX for the
+// node-based unordered_map; the default is the flat table below.
+
+// Occupancy and probe lengths of a course index, for --stats.
+struct IndexStats {
+    size_t entries = 0;
+    size_t capacity = 0;   // slots, or buckets for the node map
+    double meanProbe = 0;  // extra groups (nodes) visited per successful find
+    size_t maxProbe = 0;
+};
+
+// Swiss-table style open addressing. One control byte per slot holds either
+// kCtrlEmpty or the low 7 bits of the hash; lookups compare a whole 16-slot
+// group of control bytes at once and only touch slots whose tag matches.
+// Slots store the full hash next to the ID, so growing never rehashes keys.
+// The table is insert-only (courses are never removed), so no tombstones.
+class FlatCourseIndex {
+public:
+    // A packed key identifies its code, so only unpacked codes are compared
+    // as strings (and fetch the code from the table).
+    template <typename KeyOf>
+    CourseId find(string_view code, CodeKey k, KeyOf keyOf) const {
+        if (ctrl_.empty()) return kNoCourse;
+        size_t mask = groupMask();
+        uint32_t h = k.hash;
+        uint8_t tag = h & 0x7F;
+        for (size_t g = (h >> 7) & mask, step = 1;; g = (g + step++) & mask) {
+            const uint8_t* ctrl = ctrl_.data() + g * kGroup;
+            for (uint32_t bits = matchByte(ctrl, tag); bits; bits &= bits - 1) {
+                const Slot& s = slots_[g * kGroup + countTrailingZeros(bits)];
+                if (s.key == k.packed && s.hash == h && (k.packed || keyOf(s.id) == code)) return s.id;
+            }
+            if (matchByte(ctrl, kCtrlEmpty)) return kNoCourse;
+        }
+    }
+
+    // `code` must not already be present.
+    void insert(string_view /*code*/, CodeKey k, CourseId id) {
+        if ((size_ + 1) * 8 > ctrl_.size() * 7) grow();
+        place(Slot{k.packed, k.hash, id});
+        ++size_;
+    }
+
+    size_t size() const { return size_; }
+    size_t bytes() const { return ctrl_.bytes() + slots_.bytes(); }
+    void shrinkToFit() {}
+
+    // Replays each entry's probe sequence from its home group.
+    IndexStats stats() const {
+        IndexStats st;
+        st.entries = size_;
+        st.capacity = ctrl_.size();
+        if (ctrl_.empty()) return st;
+        size_t mask = groupMask(), total = 0;
+        for (size_t i = 0; i < ctrl_.size(); ++i) {
+            if (ctrl_[i] == kCtrlEmpty) continue;
+            size_t home = (slots_[i].hash >> 7) & mask, probes = 0;
+            for (size_t g = home, step = 1; g != i / kGroup; g = (g + step++) & mask) ++probes;
+            total += probes;
+            st.maxProbe = max(st.maxProbe, probes);
+        }
+        st.meanProbe = size_ ? (double)total / (double)size_ : 0;
+        return st;
+    }
+
+    void swap(FlatCourseIndex& o) {
+        ctrl_.swap(o.ctrl_);
+        slots_.swap(o.slots_);
+        std::swap(size_, o.size_);
+    }
+    void copyFrom(const FlatCourseIndex& o) {
+        ctrl_.copyFrom(o.ctrl_);
+        slots_.copyFrom(o.slots_);
+        size_ = o.size_;
+    }
+
+    struct Slot {
+        uint64_t key; // CodeKey::packed
+        uint32_t hash;
+        CourseId id;
+    };
+
+    // Snapshot support: the control bytes and slots are position
+    // independent, so a snapshot can store them and map them back in.
+    static const bool kSnapshotable = true;
+    Span<uint8_t> ctrlBytes() const { return ctrl_.span(); }
+    Span<Slot> slotArray() const { return slots_.span(); }
+    // Only call with arrays produced by ctrlBytes()/slotArray().
+    void borrow(Span<uint8_t> ctrl, Span<Slot> slots, size_t size) {
+        ctrl_.borrow(ctrl.ptr, ctrl.size());
+        slots_.borrow(slots.ptr, slots.size());
+        size_ = size;
+    }
+
+private:
+    static const size_t kGroup = 16;
+    static constexpr uint8_t kCtrlEmpty = 0x80;
+
+    size_t groupMask() const { return ctrl_.size() / kGroup - 1; }
+
+    // Bit i set where ctrl[i] == b.
+    static inline uint32_t matchByte(const uint8_t* ctrl, uint8_t b) {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)b)));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < kGroup; ++i) bits |= (uint32_t)(ctrl[i] == b) << i;
+        return bits;
+#endif
+    }
+
+    void place(const Slot& slot) {
+        size_t mask = groupMask();
+        for (size_t g = (slot.hash >> 7) & mask, step = 1;; g = (g + step++) & mask) {
+            uint32_t empty = matchByte(ctrl_.data() + g * kGroup, kCtrlEmpty);
+            if (empty) {
+                size_t i = g * kGroup + countTrailingZeros(empty);
+                ctrl_.at(i) = slot.hash & 0x7F;
+                slots_.at(i) = slot;
+                return;
+            }
+        }
+    }
+
+    void grow() {
+        PodArray<uint8_t> oldCtrl;
+        PodArray<Slot> oldSlots;
+        oldCtrl.swap(ctrl_);
+        oldSlots.swap(slots_);
+        ctrl_.assign(max<size_t>(kGroup * 4, oldCtrl.size() * 2), kCtrlEmpty);
+        slots_.assign(ctrl_.size(), Slot{0, 0, 0});
+        for (size_t i = 0; i < oldCtrl.size(); ++i)
+            if (oldCtrl[i] != kCtrlEmpty) place(oldSlots[i]);
+    }
+
+    PodArray<uint8_t> ctrl_;  // size is a power-of-two multiple of kGroup
+    PodArray<Slot> slots_;
+    size_t size_ = 0;
+};
+
+// The original layout: node-based map that owns a copy of every key.
+class StdCourseIndex {
+public:
+    template <typename KeyOf>
+    CourseId find(string_view code, CodeKey /*k*/, KeyOf /*keyOf*/) const {
+        auto it = map_.find(string(code));
+        return it == map_.end() ? kNoCourse : it->second;
+    }
+    void insert(string_view code, CodeKey /*k*/, CourseId id) { map_.emplace(string(code), id); }
+
+    size_t size() const { return map_.size(); }
+    size_t bytes() const {
+        // rough: bucket array plus one node (key, id, next pointer) per entry
+        return map_.bucket_count() * sizeof(void*) + map_.size() * (sizeof(string) + 2 * sizeof(void*));
+    }
+    void shrinkToFit() { map_.rehash(0); }
+    IndexStats stats() const {
+        IndexStats st;
+        st.entries = map_.size();
+        st.capacity = map_.bucket_count();
+        size_t total = 0;
+        for (size_t b = 0; b < map_.bucket_count(); ++b) {
+            size_t k = map_.bucket_size(b);
+            total += k ? k * (k - 1) / 2 : 0; // the j-th node of a chain costs j - 1 extra
+            st.maxProbe = max(st.maxProbe, k ? k - 1 : 0);
+        }
+        st.meanProbe = st.entries ? (double)total / (double)st.entries : 0;
+        return st;
+    }
+    void swap(StdCourseIndex& o) { map_.swap(o.map_); }
+    void copyFrom(const StdCourseIndex& o) { map_ = o.map_; }
+
+    // Nodes hold pointers, so snapshots skip the index and rebuild it.
+    static const bool kSnapshotable = false;
+
+private:
+    unordered_map<string, CourseId> map_;
+};
+
+#ifdef ABCU_STD_COURSE_INDEX
+using CourseIndex = StdCourseIndex;
+#else
+using CourseIndex = FlatCourseIndex;
+#endif
+
+// Interning hash table for O(1) avg insert/search. Code strings, titles and
+// prerequisite lists are stored once; everything else refers to CourseIds.
+class CourseTable {
+public:
+    // Returns the ID for `code`, adding an undefined entry if it is new.
+    CourseId intern(string_view code) {
+        CodeKey k = courseKey(code);
+        CourseId id = index_.find(code, k, keyOf());
+        if (id != kNoCourse) return id;
+        id = (CourseId)courses_.size();
+        Course c;
+        c.number = strings_.append(code);
+        if (rowHashes_.size() == courses_.size()) rowHashes_.push_back(0);
+        courses_.push_back(c);
+        index_.insert(code, k, id);
+        return id;
+    }
+
+    // kNoCourse if `code` was never interned.
+    CourseId find(string_view code) const { return index_.find(code, courseKey(code), keyOf()); }
+
+    // Sets the title and prerequisites of `id`. Redefining an ID replaces the
+    // previous row (last line wins). `rowHash` identifies the source row, for
+    // incremental reloads.
+    void define(CourseId id, string_view title, const CourseId* prereqs, size_t n, uint64_t rowHash = 0) {
+        if (id < rowHashes_.size()) rowHashes_.at(id) = rowHash;
+        Course& c = courses_.at(id);
+        if (!c.defined) ++defined_;
+        else replaced_.push_back(id);
+        c.defined = true;
+        c.title = strings_.append(title);
+        c.prereqBegin = (uint32_t)prereqs_.size();
+        c.prereqCount = (uint32_t)n;
+        prereqs_.append(prereqs, n);
+    }
+
+    // Copies every defined course of `other` into this table, re-interning
+    // its IDs. Rows from `other` win over existing ones.
+    void mergeFrom(const CourseTable& other) {
+        vector<CourseId> remap(other.courses_.size(), kNoCourse);
+        auto mapId = [&](CourseId id) {
+            if (remap[id] == kNoCourse) remap[id] = intern(other.number(id));
+            return remap[id];
+        };
+        for (CourseId id : other.replaced_) replaced_.push_back(mapId(id));
+        vector<CourseId> pre;
+        for (CourseId id = 0; id < other.courses_.size(); ++id) {
+            if (!other.courses_[id].defined) continue;
+            pre.clear();
+            for (CourseId p : other.prereqs(id)) pre.push_back(mapId(p));
+            define(mapId(id), other.title(id), pre.data(), pre.size(), other.rowHash(id));
+        }
+    }
+
+    // Drops the course row. The ID stays interned (other courses may still
+    // list it as a prerequisite) and reports as missing.
+    void undefine(CourseId id) {
+        if (!isDefined(id)) return;
+        Course& c = courses_.at(id);
+        c.defined = false;
+        c.title = StrRef();
+        c.prereqCount = 0;
+        if (id < rowHashes_.size()) rowHashes_.at(id) = 0;
+        --defined_;
+    }
+
+    bool isDefined(CourseId id) const { return id < courses_.size() && courses_[id].defined; }
+    // IDs whose row a later define() replaced, once per extra row: the
+    // duplicates of a load. Reloads replace rows on purpose and clear it.
+    const vector<CourseId>& replacedIds() const { return replaced_; }
+    void clearReplaced() { vector<CourseId>().swap(replaced_); }
+    // Hash of the source row of `id`; 0 if unknown (e.g. loaded from a snapshot).
+    uint64_t rowHash(CourseId id) const { return id < rowHashes_.size() ? rowHashes_[id] : 0; }
+    bool hasRowHashes() const { return rowHashes_.size() == courses_.size(); }
+    string_view number(CourseId id) const { return strings_.view(courses_[id].number); }
+    string_view title(CourseId id) const { return strings_.view(courses_[id].title); }
+    Span<CourseId> prereqs(CourseId id) const {
+        const Course& c = courses_[id];
+        return {prereqs_.data() + c.prereqBegin, c.prereqCount};
+    }
+
+    size_t size() const { return defined_; }        // defined courses
+    size_t idCount() const { return courses_.size(); } // all interned codes
+    bool empty() const { return defined_ == 0; }
+
+    void reserveBytes(size_t n) { strings_.reserve(n); }
+    void shrinkToFit() {
+        strings_.shrinkToFit();
+        courses_.shrinkToFit();
+        rowHashes_.shrinkToFit();
+        prereqs_.shrinkToFit();
+        index_.shrinkToFit();
+    }
+    // Heap bytes; a table loaded from a snapshot mostly lives in the mapping.
+    IndexStats indexStats() const { return index_.stats(); }
+    size_t memoryBytes() const {
+        return strings_.bytes() + courses_.bytes() + rowHashes_.bytes() + prereqs_.bytes() + index_.bytes();
+    }
+
+    // Raw arrays, for writing snapshots.
+    Span<char> stringBytes() const { return strings_.storage().span(); }
+    Span<Course> courseRecords() const { return courses_.span(); }
+    Span<CourseId> prereqPool() const { return prereqs_.span(); }
+    const CourseIndex& index() const { return index_; }
+
+    // Points the table at arrays inside `backing` instead of copying them.
+    // The arrays must be what stringBytes()/courseRecords()/prereqPool()
+    // returned when the snapshot was written. Without an index (index
+    // layouts that cannot be stored) it is rebuilt from the codes.
+    void borrow(shared_ptr<const void> backing, Span<char> strings, Span<Course> courses, Span<CourseId> prereqs,
+                size_t definedCount) {
+        backing_ = std::move(backing);
+        strings_.storage().borrow(strings.ptr, strings.size());
+        courses_.borrow(courses.ptr, courses.size());
+        rowHashes_.clear();
+        prereqs_.borrow(prereqs.ptr, prereqs.size());
+        defined_ = definedCount;
+        CourseIndex().swap(index_);
+    }
+    // Points codes and titles at `store`, an arena shared with other tables;
+    // refs[id] is course id's {number, title} there. Anything else this
+    // table borrows stays borrowed.
+    void shareStrings(shared_ptr<const StringArena> store, const vector<pair<StrRef, StrRef>>& refs) {
+        for (CourseId id = 0; id < courses_.size(); ++id) {
+            Course& c = courses_.at(id);
+            c.number = refs[id].first;
+            c.title = refs[id].second;
+        }
+        strings_.storage().borrow(store->storage().data(), store->storage().size());
+        if (backing_)
+            backing_ = make_shared<pair<shared_ptr<const void>, shared_ptr<const void>>>(std::move(backing_), store);
+        else
+            backing_ = std::move(store);
+    }
+    CourseIndex& mutableIndex() { return index_; }
+    void rebuildIndex() {
+        CourseIndex().swap(index_);
+        for (CourseId id = 0; id < courses_.size(); ++id) index_.insert(number(id), courseKey(number(id)), id);
+    }
+
+    void swap(CourseTable& o) {
+        strings_.swap(o.strings_);
+        courses_.swap(o.courses_);
+        rowHashes_.swap(o.rowHashes_);
+        prereqs_.swap(o.prereqs_);
+        index_.swap(o.index_);
+        backing_.swap(o.backing_);
+        replaced_.swap(o.replaced_);
+        std::swap(defined_, o.defined_);
+    }
+
+    // Deep copy of owned storage; snapshot-backed arrays are shared. The
+    // copy starts with no replaced IDs.
+    void copyFrom(const CourseTable& o) {
+        strings_.copyFrom(o.strings_);
+        courses_.copyFrom(o.courses_);
+        rowHashes_.copyFrom(o.rowHashes_);
+        prereqs_.copyFrom(o.prereqs_);
+        index_.copyFrom(o.index_);
+        backing_ = o.backing_;
+        replaced_.clear();
+        defined_ = o.defined_;
+    }
+
+private:
+    struct KeyOf {
+        const CourseTable* table;
+        string_view operator()(CourseId id) const { return table->number(id); }
+    };
+    KeyOf keyOf() const { return KeyOf{this}; }
+
+    StringArena strings_;
+    PodArray<Course> courses_;   // indexed by CourseId
+    PodArray<uint64_t> rowHashes_; // per CourseId; empty for snapshot-backed tables
+    PodArray<CourseId> prereqs_; // pooled prerequisite lists
+    CourseIndex index_;
+    shared_ptr<const void> backing_; // keeps borrowed memory alive
+    vector<CourseId> replaced_;
+    size_t defined_ = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Prerequisite graph
+// -----------------------------------------------------------------------------
+class ReachabilityIndex;
+
+// Built once per load from the table's prerequisite lists. Edges run from a
+// course to each of its prerequisites, stored as CSR (one offset per
+// CourseId into a flat edge array). Closures are computed on first request
+// and memoized, so repeat queries cost O(size of the result).
+class PrereqGraph {
+public:
+    struct Entry {
+        CourseId id;
+        uint32_t depth; // 1 = direct prerequisite
+    };
+
+    static const size_t kMaxReportedCycles = 10;
+
+    // `sortedKeys` fixes the order of courses within one depth.
+    PrereqGraph(const CourseTable& table, Span<CourseId> sortedKeys) {
+        size_t n = table.idCount();
+        rank_.resize(n);
+        for (CourseId id = 0; id < n; ++id) rank_[id] = (uint32_t)(sortedKeys.size() + id); // missing courses last
+        for (size_t i = 0; i < sortedKeys.size(); ++i) rank_[sortedKeys[i]] = (uint32_t)i;
+        offsets_.assign(n + 1, 0);
+        for (CourseId id = 0; id < n; ++id) {
+            size_t begin = edges_.size();
+            for (CourseId p : table.prereqs(id)) edges_.push_back(p);
+            // a row listing the same prerequisite twice adds one edge
+            sort(edges_.begin() + begin, edges_.end());
+            edges_.erase(unique(edges_.begin() + begin, edges_.end()), edges_.end());
+            offsets_[id + 1] = (uint32_t)edges_.size();
+        }
+        // reverse CSR by counting sort; filling from the courses in list
+        // order keeps each dependents list in list order (undefined courses
+        // have no prerequisites, so sortedKeys covers every edge)
+        revOffsets_.assign(n + 1, 0);
+        for (CourseId p : edges_) ++revOffsets_[p + 1];
+        for (size_t i = 0; i < n; ++i) revOffsets_[i + 1] += revOffsets_[i];
+        revEdges_.resize(edges_.size());
+        vector<uint32_t> cursor(revOffsets_.begin(), revOffsets_.end() - 1);
+        for (CourseId id : sortedKeys)
+            for (CourseId p : direct(id)) revEdges_[cursor[p]++] = id;
+        memo_.resize(n);
+        orderAndFindCycles();
+    }
+
+    // Position of `id` in the list order given at construction.
+    uint32_t rank(CourseId id) const { return rank_[id]; }
+
+    Span<CourseId> direct(CourseId id) const { return {edges_.data() + offsets_[id], offsets_[id + 1] - offsets_[id]}; }
+
+    // Courses listing `id` as a direct prerequisite, in list order.
+    Span<CourseId> dependents(CourseId id) const {
+        return {revEdges_.data() + revOffsets_[id], revOffsets_[id + 1] - revOffsets_[id]};
+    }
+
+    // Every course that needs `id` directly or through others, ordered by
+    // minimum depth (1 = direct dependent), then in list order. The visited
+    // marks live in a per-thread array reset by generation, so the cost is
+    // proportional to the answer (plus sorting each depth), not to the
+    // catalog. Not cached: unlike closure() the answers are rarely reused.
+    void dependentClosure(CourseId start, vector<Entry>& out) const {
+        thread_local vector<uint32_t> mark;
+        thread_local uint32_t generation = 0;
+        if (mark.size() < idCount()) mark.resize(idCount(), 0);
+        if (++generation == 0) {
+            fill(mark.begin(), mark.end(), 0);
+            generation = 1;
+        }
+        out.clear();
+        mark[start] = generation;
+        size_t begin = 0;
+        out.push_back({start, 0});
+        for (uint32_t depth = 1; begin < out.size(); ++depth) {
+            size_t end = out.size();
+            for (size_t i = begin; i < end; ++i)
+                for (CourseId d : dependents(out[i].id))
+                    if (mark[d] != generation) {
+                        mark[d] = generation;
+                        out.push_back({d, depth});
+                    }
+            sort(out.begin() + end, out.end(), [&](const Entry& a, const Entry& b) { return rank_[a.id] < rank_[b.id]; });
+            begin = end;
+        }
+        out.erase(out.begin()); // `start` itself
+    }
+
+    // Every course reachable through prerequisites, ordered by minimum depth
+    // (then alphanumerically). Terminates on cyclic data; a course on a cycle does
+    // not list itself.
+    Span<Entry> closure(CourseId id) const {
+        lock_guard<mutex> lock(memoMutex_);
+        unique_ptr<vector<Entry>>& slot = memo_[id];
+        if (!slot) slot.reset(new vector<Entry>(computeClosure(id)));
+        return {slot->data(), slot->size()};
+    }
+
+    // Bitset index over the closures, built on first use. A reload builds a
+    // new graph, which discards it.
+    const ReachabilityIndex& reachability() const;
+
+    size_t idCount() const { return offsets_.size() - 1; }
+
+    // Strongly connected components: courses on a common cycle share one.
+    // Component IDs are numbered prerequisites-first: every edge leads to a
+    // component with an equal or lower ID.
+    uint32_t component(CourseId id) const { return comp_[id]; }
+    uint32_t componentCount() const { return compCount_; }
+
+    // All CourseIds, prerequisites before the courses that need them (for
+    // cyclic data, the order inside a cycle is arbitrary).
+    const vector<CourseId>& topoOrder() const { return topo_; }
+
+    // Up to kMaxReportedCycles example cycles, each as a path A, B, ..., A.
+    const vector<vector<CourseId>>& cycles() const { return cycles_; }
+    size_t cycleCount() const { return cycleCount_; }
+
+private:
+    vector<Entry> computeClosure(CourseId start) const {
+        // BFS gives minimum depth directly; `seen` is sparse so cost stays
+        // proportional to the closure, not the catalog
+        vector<Entry> out;
+        unordered_map<CourseId, bool> seen;
+        seen[start] = true;
+        vector<CourseId> frontier{start}, next;
+        for (uint32_t depth = 1; !frontier.empty(); ++depth) {
+            next.clear();
+            for (CourseId u : frontier)
+                for (CourseId p : direct(u))
+                    if (seen.emplace(p, true).second) next.push_back(p);
+            sort(next.begin(), next.end(), [&](CourseId a, CourseId b) { return rank_[a] < rank_[b]; });
+            for (CourseId p : next) out.push_back({p, depth});
+            frontier.swap(next);
+        }
+        return out;
+    }
+
+    // Iterative DFS: post-order gives the topological order, and an edge back
+    // to a node still on the path closes a cycle. The same pass runs Tarjan's
+    // algorithm to group the courses into strongly connected components.
+    void orderAndFindCycles() {
+        enum : uint8_t { White, Gray, Black };
+        size_t n = memo_.size();
+        vector<uint8_t> color(n, White);
+        vector<uint32_t> index(n), low(n);
+        vector<CourseId> sccStack;
+        vector<bool> onStack(n, false);
+        uint32_t counter = 0;
+        vector<pair<CourseId, uint32_t>> stack; // node, next edge to follow
+        auto visit = [&](CourseId v) {
+            color[v] = Gray;
+            index[v] = low[v] = counter++;
+            sccStack.push_back(v);
+            onStack[v] = true;
+            stack.push_back({v, offsets_[v]});
+        };
+
+        topo_.reserve(n);
+        comp_.assign(n, 0);
+        for (CourseId root = 0; root < n; ++root) {
+            if (color[root] != White) continue;
+            visit(root);
+            while (!stack.empty()) {
+                CourseId u = stack.back().first;
+                uint32_t& e = stack.back().second;
+                if (e == offsets_[u + 1]) {
+                    color[u] = Black;
+                    topo_.push_back(u);
+                    stack.pop_back();
+                    if (!stack.empty()) {
+                        CourseId parent = stack.back().first;
+                        low[parent] = min(low[parent], low[u]);
+                    }
+                    if (low[u] == index[u]) {
+                        CourseId w;
+                        do {
+                            w = sccStack.back();
+                            sccStack.pop_back();
+                            onStack[w] = false;
+                            comp_[w] = compCount_;
+                        } while (w != u);
+                        ++compCount_;
+                    }
+                    continue;
+                }
+                CourseId v = edges_[e++];
+                if (color[v] == White) {
+                    visit(v);
+                    continue;
+                }
+                if (onStack[v]) low[u] = min(low[u], index[v]);
+                if (color[v] == Gray) {
+                    ++cycleCount_;
+                    if (cycles_.size() < kMaxReportedCycles) {
+                        vector<CourseId> cyc;
+                        size_t i = stack.size();
+                        while (stack[i - 1].first != v) --i;
+                        for (; i <= stack.size(); ++i) cyc.push_back(stack[i - 1].first);
+                        cyc.push_back(v);
+                        cycles_.push_back(std::move(cyc));
+                    }
+                }
+            }
+        }
+    }
+
+    vector<uint32_t> offsets_;
+    vector<CourseId> edges_;
+    vector<uint32_t> revOffsets_; // the same edges reversed: course -> dependents
+    vector<CourseId> revEdges_;
+    vector<uint32_t> rank_;  // position in sortedKeys
+    vector<CourseId> topo_;
+    vector<uint32_t> comp_;  // strongly connected component of each CourseId
+    uint32_t compCount_ = 0;
+    vector<vector<CourseId>> cycles_;
+    size_t cycleCount_ = 0;
+
+    mutable mutex memoMutex_;
+    mutable vector<unique_ptr<vector<Entry>>> memo_;
+
+    mutable once_flag reachOnce_;
+    mutable unique_ptr<ReachabilityIndex> reach_;
+};
+
+// -----------------------------------------------------------------------------
+// Reachability index
+// -----------------------------------------------------------------------------
+// Set of CourseIds, one bit each.
+class CourseSet {
+public:
+    explicit CourseSet(size_t idCount = 0) : words_((idCount + 63) / 64, 0) {}
+    void add(CourseId id) { words_[id >> 6] |= uint64_t(1) << (id & 63); }
+    bool contains(CourseId id) const { return (id >> 6) < words_.size() && (words_[id >> 6] >> (id & 63)) & 1; }
+    const vector<uint64_t>& words() const { return words_; }
+
+private:
+    vector<uint64_t> words_;
+};
+
+// Transitive prerequisites of every course as a bitset, so "has the student
+// completed everything course X needs?" is a word-wise AND-NOT against the
+// student's CourseSet. Rows are stored per strongly connected component
+// (courses on a prerequisite cycle all reach the same set), filled in one
+// pass in component order. Small catalogs get dense rows (n bits each);
+// larger ones store only the non-zero 64-bit words of each row, which keeps
+// memory proportional to the total closure size.
+class ReachabilityIndex {
+public:
+    static const size_t kDenseMaxIds = 8192; // dense rows: at most 8 MiB
+
+    explicit ReachabilityIndex(const PrereqGraph& graph);
+
+    // True if every transitive prerequisite of `course` is in `done`.
+    bool eligible(CourseId course, const CourseSet& done) const {
+        uint64_t missing = 0;
+        forEachWord(course, done, [&](uint32_t, uint64_t bits) { missing |= bits; });
+        return missing == 0;
+    }
+
+    // Appends the prerequisites of `course` that are not in `done`.
+    void missing(CourseId course, const CourseSet& done, vector<CourseId>& out) const {
+        forEachWord(course, done, [&](uint32_t w, uint64_t bits) {
+            for (; bits; bits &= bits - 1) out.push_back(w * 64 + (CourseId)countTrailingZeros(bits));
+        });
+    }
+
+    size_t bytes() const {
+        return rows_.capacity() * sizeof(uint64_t) + wordIdx_.capacity() * sizeof(uint32_t) +
+               begin_.capacity() * sizeof(uint32_t) + comp_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    // Calls fn(word, bits) with the prerequisite bits of `course` that are
+    // missing from `done`. A course on a cycle is in its own component's
+    // row; that bit is masked out.
+    template <typename Fn>
+    void forEachWord(CourseId course, const CourseSet& done, Fn fn) const {
+        const vector<uint64_t>& d = done.words();
+        uint32_t self = course >> 6;
+        uint64_t selfBit = uint64_t(1) << (course & 63);
+        auto need = [&](uint32_t w, uint64_t row) {
+            return row & ~(w < d.size() ? d[w] : 0) & ~(w == self ? selfBit : 0);
+        };
+        uint32_t c = comp_[course];
+        if (dense_) {
+            // branch-free so the compiler can vectorize it
+            const uint64_t* row = &rows_[(size_t)c * words_];
+            for (uint32_t w = 0; w < words_; ++w) fn(w, need(w, row[w]));
+        } else {
+            for (uint32_t i = begin_[c]; i < begin_[c + 1]; ++i) fn(wordIdx_[i], need(wordIdx_[i], rows_[i]));
+        }
+    }
+
+    bool dense_ = true;
+    size_t words_ = 0;           // words per dense row
+    vector<uint32_t> comp_;      // CourseId -> component (row)
+    vector<uint64_t> rows_;      // dense: compCount * words_; sparse: non-zero words
+    vector<uint32_t> wordIdx_;   // sparse: word index of each rows_ entry
+    vector<uint32_t> begin_;     // sparse: component -> first rows_ entry
+};
+
+inline ReachabilityIndex::ReachabilityIndex(const PrereqGraph& graph) {
+    size_t n = graph.idCount();
+    uint32_t comps = graph.componentCount();
+    words_ = (n + 63) / 64;
+    dense_ = n <= kDenseMaxIds;
+
+    // Members of each component; component IDs are already prerequisites-first.
+    comp_.resize(n);
+    vector<uint32_t> memberBegin(comps + 1, 0);
+    for (CourseId id = 0; id < n; ++id) {
+        comp_[id] = graph.component(id);
+        ++memberBegin[comp_[id] + 1];
+    }
+    for (uint32_t c = 0; c < comps; ++c) memberBegin[c + 1] += memberBegin[c];
+    vector<CourseId> members(n);
+    {
+        vector<uint32_t> fill(memberBegin.begin(), memberBegin.end() - 1);
+        for (CourseId id = 0; id < n; ++id) members[fill[comp_[id]]++] = id;
+    }
+
+    // Row of component C = every direct prerequisite p of a member, plus the
+    // row of p's component when that is a different (earlier) one.
+    vector<uint64_t> scratch(words_, 0);
+    vector<uint32_t> touched;
+    auto orWord = [&](uint32_t w, uint64_t bits) {
+        if (!scratch[w]) touched.push_back(w);
+        scratch[w] |= bits;
+    };
+    if (dense_) rows_.assign((size_t)comps * words_, 0);
+    else begin_.assign(comps + 1, 0);
+
+    for (uint32_t c = 0; c < comps; ++c) {
+        for (uint32_t m = memberBegin[c]; m < memberBegin[c + 1]; ++m) {
+            for (CourseId p : graph.direct(members[m])) {
+                orWord(p >> 6, uint64_t(1) << (p & 63));
+                uint32_t pc = comp_[p];
+                if (pc == c) continue;
+                if (dense_) {
+                    const uint64_t* pr = &rows_[(size_t)pc * words_];
+                    for (uint32_t w = 0; w < words_; ++w)
+                        if (pr[w]) orWord(w, pr[w]);
+                } else {
+                    for (uint32_t i = begin_[pc]; i < begin_[pc + 1]; ++i) orWord(wordIdx_[i], rows_[i]);
+                }
+            }
+        }
+        if (!dense_) sort(touched.begin(), touched.end());
+        for (uint32_t w : touched) {
+            if (dense_) rows_[(size_t)c * words_ + w] = scratch[w];
+            else {
+                wordIdx_.push_back(w);
+                rows_.push_back(scratch[w]);
+            }
+            scratch[w] = 0;
+        }
+        touched.clear();
+        if (!dense_) begin_[c + 1] = (uint32_t)rows_.size();
+    }
+}
+
+inline const ReachabilityIndex& PrereqGraph::reachability() const {
+    call_once(reachOnce_, [this] { reach_.reset(new ReachabilityIndex(*this)); });
+    return *reach_;
+}
+
+// How the course list (and each depth of Option 4) is ordered: by code
+// bytes, or with number runs compared by value (CSCI200 before CSCI1000).
+enum class CourseOrder { Code, Natural };
+
+struct LoadOptions {
+    unsigned threads = 0; // 0 = pick automatically from file size / core count
+    CourseOrder order = CourseOrder::Code;
+    bool snapshotOnly = false; // reject anything that is not a binary snapshot
+    bool quiet = false;   // skip the "Loaded N courses" message
+    unsigned threadCap = 0; // if set, bounds the automatic thread choice (files loading side by side)
+};
+
+// Size and modification time of a file, to skip reloads of unchanged files.
+struct FileStamp {
+    bool valid = false;
+    uintmax_t size = 0;
+    filesystem::file_time_type mtime{};
+
+    static FileStamp of(const string& path) {
+        FileStamp st;
+        error_code ec;
+        st.size = filesystem::file_size(path, ec);
+        if (ec) return st;
+        st.mtime = filesystem::last_write_time(path, ec);
+        st.valid = !ec;
+        return st;
+    }
+    bool operator==(const FileStamp& o) const { return valid == o.valid && size == o.size && mtime == o.mtime; }
+};
+
+// -----------------------------------------------------------------------------
+// Catalog publication
+// -----------------------------------------------------------------------------
+// Hazard pointers for the lock-free readers below. A reader announces the
+// pointer it is about to follow and re-checks that it is still current; a
+// writer that has unlinked a pointer waits until no reader announces it
+// before freeing it. Readers only ever wait on nothing; writers wait for a
+// handful of reader instructions.
+class HazardPointers {
+public:
+    struct alignas(64) Record { // one cache line each, so readers don't share
+        atomic<const void*> ptr{nullptr};
+        atomic<bool> inUse{false};
+        Record* next = nullptr;
+    };
+
+    HazardPointers() = default;
+    HazardPointers(const HazardPointers&) = delete;
+    HazardPointers& operator=(const HazardPointers&) = delete;
+    ~HazardPointers() {
+        for (Record* h = head_.load(); h;) {
+            Record* next = h->next;
+            delete h;
+            h = next;
+        }
+    }
+
+    // A record for the calling reader. Records are never freed while the set
+    // lives; a reader reuses any idle one and only allocates when all are busy.
+    Record* acquire() const {
+        for (Record* h = head_.load(memory_order_acquire); h; h = h->next) {
+            bool idle = false;
+            if (!h->inUse.load(memory_order_relaxed) && h->inUse.compare_exchange_strong(idle, true)) return h;
+        }
+        Record* h = new Record;
+        h->inUse.store(true);
+        Record* head = head_.load();
+        do h->next = head;
+        while (!head_.compare_exchange_weak(head, h));
+        return h;
+    }
+    static void release(Record* h) {
+        h->ptr.store(nullptr);
+        h->inUse.store(false, memory_order_release);
+    }
+
+    // Returns once no reader announces `p`; `p` must already be unreachable.
+    void waitUntilUnused(const void* p) const {
+        for (Record* h = head_.load(); h; h = h->next)
+            while (h->ptr.load() == p) this_thread::yield();
+    }
+
+private:
+    mutable atomic<Record*> head_{nullptr};
+};
+
+// Holds the current immutable value for any number of reader threads.
+// Readers never lock: load() protects the current node with a hazard
+// pointer just long enough to copy its shared_ptr, so a reader keeps its
+// snapshot alive for as long as it holds the copy. store() swaps the new
+// node in, waits for hazard pointers to the old node to clear (a handful of
+// instructions on the reader side), and drops the old node; the value itself
+// is freed when its last reader lets go. store() is meant for one writer at
+// a time (the loader).
+template <typename T>
+class Published {
+public:
+    Published() = default;
+    Published(const Published&) = delete;
+    Published& operator=(const Published&) = delete;
+    ~Published() { delete current_.load(); }
+
+    shared_ptr<const T> load() const {
+        HazardPointers::Record* h = hazards_.acquire();
+        Node* n;
+        do {
+            n = current_.load();
+            h->ptr.store(n);
+        } while (n != current_.load());
+        shared_ptr<const T> out = n ? n->value : nullptr;
+        HazardPointers::release(h);
+        return out;
+    }
+
+    void store(shared_ptr<const T> value) {
+        Node* old = current_.exchange(new Node{std::move(value)});
+        if (!old) return;
+        hazards_.waitUntilUnused(old);
+        delete old;
+    }
+
+private:
+    struct Node {
+        shared_ptr<const T> value;
+    };
+
+    atomic<Node*> current_{nullptr};
+    HazardPointers hazards_;
+};
+
+class SearchIndex;
+class CourseColumns;
+
+// Precomputed sort keys, one per CourseId: comparing two keys bytewise
+// gives their collation order, so sorting is a radix sort and listing a
+// scan. Undefined IDs have empty keys.
+struct CollationKeys {
+    string bytes;
+    vector<uint32_t> offsets; // idCount() + 1
+
+    string_view of(CourseId id) const {
+        return string_view(bytes).substr(offsets[id], offsets[id + 1] - offsets[id]);
+    }
+};
+
+// Bounded cache of rendered course output, keyed by CourseId. Lookups skew
+// heavily toward a few hundred intro courses, and a hit is one copy instead
+// of a title lookup per prerequisite. Readers never lock, so it is
+// set-associative: an ID hashes to one set of kWays slots, each an atomic
+// entry pointer. A reader protects the entry it finds with a hazard pointer
+// and sets the slot's reference bit. A writer picks a victim in the set by
+// CLOCK (the hand clears reference bits and takes the first slot whose bit
+// was already clear), swaps its entry in by compare-and-swap, and frees the
+// old one once no reader holds it. New entries start unreferenced, so a
+// sweep over cold courses replaces other cold entries before the hot ones.
+class RenderCache {
+public:
+    static const size_t kDefaultEntries = 1024;
+    static constexpr size_t kWays = 8;
+
+    explicit RenderCache(size_t capacity = kDefaultEntries) {
+        unsigned bits = 0;
+        while (((size_t)kWays << bits) < capacity) ++bits;
+        shift_ = 32 - bits;
+        sets_.reset(new Set[(size_t)1 << bits]);
+        setCount_ = (size_t)1 << bits;
+    }
+    ~RenderCache() {
+        for (size_t i = 0; i < setCount_; ++i)
+            for (Slot& s : sets_[i].slots) delete s.entry.load(memory_order_relaxed);
+    }
+    RenderCache(const RenderCache&) = delete;
+    RenderCache& operator=(const RenderCache&) = delete;
+
+    // Appends the cached text of `id` to `out`; false, appending nothing, on
+    // a miss.
+    bool appendTo(CourseId id, string& out) const {
+        Set& set = setOf(id);
+        HazardPointers::Record* h = nullptr;
+        bool hit = false;
+        for (Slot& s : set.slots) {
+            if (s.id.load(memory_order_relaxed) != id) continue; // a hint; the entry decides
+            if (!h) h = hazards_.acquire();
+            const Entry* e;
+            do {
+                e = s.entry.load();
+                h->ptr.store(e);
+            } while (e != s.entry.load());
+            if (e && e->id == id) {
+                out.append(e->text);
+                if (!s.referenced.load(memory_order_relaxed)) s.referenced.store(true, memory_order_relaxed);
+                hit = true;
+                break;
+            }
+        }
+        if (h) HazardPointers::release(h);
+        return hit;
+    }
+
+    void insert(CourseId id, string_view text) {
+        Set& set = setOf(id);
+        for (Slot& s : set.slots)
+            if (s.id.load(memory_order_relaxed) == id) return; // another thread rendered it first
+        Entry* e = new Entry{id, string(text)};
+        // two turns of the hand clear every bit; stop there if writers keep
+        // beating us to the slots
+        for (size_t turn = 0; turn < 2 * kWays + 1; ++turn) {
+            Slot& s = set.slots[set.hand.fetch_add(1, memory_order_relaxed) % kWays];
+            Entry* old = s.entry.load();
+            if (old && s.referenced.exchange(false, memory_order_relaxed)) continue; // second chance
+            if (!s.entry.compare_exchange_strong(old, e)) continue;
+            s.id.store(id, memory_order_relaxed);
+            if (old) {
+                hazards_.waitUntilUnused(old);
+                delete old;
+            }
+            return;
+        }
+        delete e;
+    }
+
+private:
+    struct Entry {
+        CourseId id;
+        string text;
+    };
+    struct Slot {
+        atomic<Entry*> entry{nullptr};
+        atomic<CourseId> id{kNoCourse}; // entry's ID, checked before following it
+        atomic<bool> referenced{false};
+    };
+    struct alignas(64) Set {
+        Slot slots[kWays];
+        atomic<unsigned> hand{0};
+    };
+    // Fibonacci hashing: neighbouring IDs land in different sets.
+    Set& setOf(CourseId id) const { return sets_[shift_ >= 32 ? 0 : (uint32_t)(id * 0x9E3779B1u) >> shift_]; }
+
+    unique_ptr<Set[]> sets_;
+    size_t setCount_ = 0;
+    unsigned shift_ = 32;
+    HazardPointers hazards_;
+};
+
+// Everything one load produces. Immutable once published, so any number of
+// threads can query it while the next load is built off to the side.
+struct Catalog {
+    CourseTable courses;
+    PodArray<CourseId> sortedKeys; // cached for consistent alphanumeric output
+
+    // With --order natural, the list order and the keys it was sorted by.
+    // sortedKeys stays in code order for prefix search and snapshots.
+    CourseOrder order = CourseOrder::Code;
+    CollationKeys naturalKeys;
+    PodArray<CourseId> naturalOrder;
+
+    // Order of Option 2 and of each depth in Option 4.
+    Span<CourseId> listOrder() const {
+        return order == CourseOrder::Natural ? naturalOrder.span() : sortedKeys.span();
+    }
+
+    // Built before publishing for CSV input, so cycles are reported at load
+    // time; a snapshot load defers it to first use.
+    const PrereqGraph& prereqGraph() const {
+        call_once(graphOnce_, [this] {
+            if (!graph) graph.reset(new PrereqGraph(courses, listOrder()));
+        });
+        return *graph;
+    }
+    mutable unique_ptr<PrereqGraph> graph;
+
+    // Typeahead index over codes and titles; built like the graph.
+    const SearchIndex& search() const;
+    mutable unique_ptr<SearchIndex> searchIndex;
+
+    // Column-per-field copy in list order, for whole-catalog scans; built
+    // on first use.
+    const CourseColumns& columns() const;
+    mutable unique_ptr<CourseColumns> columnStore;
+
+    // Rendered Option 3 text and /course JSON of recently shown courses.
+    // Each load starts empty, so entries never outlive the data.
+    mutable RenderCache courseText, courseJson;
+
+private:
+    mutable once_flag graphOnce_;
+    mutable once_flag searchOnce_;
+    mutable once_flag columnsOnce_;
+};
+
+// One catalog of a multi-campus load: a namespace queries can target.
+struct Campus {
+    string name;
+    Published<Catalog> catalog;
+    string sourceFile;
+    FileStamp sourceStamp;
+};
+
+static const Campus* findCampus(const vector<unique_ptr<Campus>>& campuses, string_view name) {
+    for (const auto& c : campuses)
+        if (c->name == name) return c.get();
+    return nullptr;
+}
+
+struct ProgramState {
+    LoadOptions loadOptions;
+    Published<Catalog> catalog;  // empty until the first successful load
+
+    // Loader-side bookkeeping for Option 6.
+    string sourceFile;
+    FileStamp sourceStamp;
+
+    // --campus loads: one catalog per campus, all borrowing one deduplicated
+    // string store. `catalog` and the fields above mirror the active campus.
+    vector<unique_ptr<Campus>> campuses;
+    size_t activeCampus = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Utility Helpers
+// -----------------------------------------------------------------------------
+
+// trim helpers (string_view based so the load path never copies a field)
+static inline string_view ltrim(string_view s) {
+    size_t i = 0;
+    while (i < s.size() && isspace((unsigned char)s[i])) ++i;
+    return s.substr(i);
+}
+static inline string_view rtrim(string_view s) {
+    size_t n = s.size();
+    while (n > 0 && isspace((unsigned char)s[n - 1])) --n;
+    return s.substr(0, n);
+}
+static inline string_view trim(string_view s) { return rtrim(ltrim(s)); }
+
+// A normalized course code, stored inline. Codes are short ("CSCI200"), so
+// building one never touches the heap; a pathological code longer than
+// kInline spills to a string rather than being cut off.
+class CourseCode {
+public:
+    static const size_t kInline = 23;
+
+    string_view view() const { return size_ > kInline ? string_view(spill_) : string_view(buf_, size_); }
+    operator string_view() const { return view(); }
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+    friend bool operator==(const CourseCode& a, const CourseCode& b) { return a.view() == b.view(); }
+    friend bool operator<(const CourseCode& a, const CourseCode& b) { return a.view() < b.view(); }
+
+    void clear() {
+        size_ = 0;
+        spill_.clear();
+    }
+    void push_back(char ch) {
+        if (size_ < kInline) {
+            buf_[size_++] = ch;
+            return;
+        }
+        if (size_ == kInline) spill_.assign(buf_, kInline);
+        spill_.push_back(ch);
+        ++size_;
+    }
+
+private:
+    char buf_[kInline];
+    uint32_t size_ = 0;
+    string spill_;
+};
+
+// Normalize course IDs → uppercase, strip spaces/dashes/underscores.
+// Accepts input like "cs-200" or "  cs 200 ". ASCII only, like the C locale
+// isspace/toupper it replaces, without the per-character library calls.
+static void normalizeCourseId(string_view s, CourseCode& out) {
+    out.clear();
+    for (char ch : s) {
+        if (ch == ' ' || (ch >= '\t' && ch <= '\r') || ch == '-' || ch == '_' || ch == ',') continue;
+        out.push_back(ch >= 'a' && ch <= 'z' ? (char)(ch - 'a' + 'A') : ch);
+    }
+}
+static CourseCode normalizeCourseId(string_view s) {
+    CourseCode out;
+    normalizeCourseId(s, out);
+    return out;
+}
+
+// CSV block scanning. The record and field splitters look at 64 bytes at a
+// time: one pass builds bitmasks of the quote, comma and newline bytes, a
+// prefix XOR over the quote mask marks every byte inside a quoted field, and
+// the separators are then walked with count-trailing-zeros instead of a
+// branch per byte. Escaped quotes ("") toggle twice, so they need no special
+// case. Only a quote that opens a field (after any blanks) starts a quoted
+// field, so a stray one inside an unquoted field is kept as text instead of
+// running the record on to the next quote. The widest scanner the CPU supports is picked once at first use;
+// -DABCU_SCALAR_CSV forces the portable one.
+struct CsvBlockMasks {
+    uint64_t quote, comma, newline; // bit i = byte i of the block
+};
+using CsvBlockScanner = CsvBlockMasks (*)(const char* block);
+
+[[maybe_unused]] static CsvBlockMasks scanCsvBlockScalar(const char* p) {
+    CsvBlockMasks m{0, 0, 0};
+    for (unsigned i = 0; i < 64; ++i) {
+        m.quote |= (uint64_t)(p[i] == '"') << i;
+        m.comma |= (uint64_t)(p[i] == ',') << i;
+        m.newline |= (uint64_t)(p[i] == '\n') << i;
+    }
+    return m;
+}
+
+#if !defined(ABCU_SCALAR_CSV) && (defined(__SSE2__) || defined(_M_X64))
+#define ABCU_HAVE_SSE2_CSV 1
+static CsvBlockMasks scanCsvBlockSse2(const char* p) {
+    const __m128i quote = _mm_set1_epi8('"'), comma = _mm_set1_epi8(','), newline = _mm_set1_epi8('\n');
+    CsvBlockMasks m{0, 0, 0};
+    for (unsigned i = 0; i < 64; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        m.quote |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+        m.comma |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)) << i;
+        m.newline |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)) << i;
+    }
+    return m;
+}
+#endif
+
+#if !defined(ABCU_SCALAR_CSV) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ABCU_HAVE_AVX2_CSV 1
+__attribute__((target("avx2"))) static CsvBlockMasks scanCsvBlockAvx2(const char* p) {
+    const __m256i quote = _mm256_set1_epi8('"'), comma = _mm256_set1_epi8(','), newline = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    auto mask = [](__m256i a, __m256i b, __m256i c) __attribute__((target("avx2"))) {
+        return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, c)) |
+               (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, c)) << 32;
+    };
+    return {mask(lo, hi, quote), mask(lo, hi, comma), mask(lo, hi, newline)};
+}
+#endif
+
+#if !defined(ABCU_SCALAR_CSV) && defined(__aarch64__)
+#define ABCU_HAVE_NEON_CSV 1
+static inline uint64_t neonMask64(uint8x16_t m0, uint8x16_t m1, uint8x16_t m2, uint8x16_t m3) {
+    const uint8x16_t weight = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t s01 = vpaddq_u8(vandq_u8(m0, weight), vandq_u8(m1, weight));
+    uint8x16_t s23 = vpaddq_u8(vandq_u8(m2, weight), vandq_u8(m3, weight));
+    uint8x16_t s = vpaddq_u8(s01, s23);
+    s = vpaddq_u8(s, s);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(s), 0);
+}
+static CsvBlockMasks scanCsvBlockNeon(const char* p) {
+    const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+    uint8x16_t v0 = vld1q_u8(u), v1 = vld1q_u8(u + 16), v2 = vld1q_u8(u + 32), v3 = vld1q_u8(u + 48);
+    auto mask = [&](uint8_t c) {
+        uint8x16_t k = vdupq_n_u8(c);
+        return neonMask64(vceqq_u8(v0, k), vceqq_u8(v1, k), vceqq_u8(v2, k), vceqq_u8(v3, k));
+    };
+    return {mask('"'), mask(','), mask('\n')};
+}
+#endif
+
+static CsvBlockScanner pickCsvScanner() {
+#if defined(ABCU_HAVE_AVX2_CSV)
+    if (__builtin_cpu_supports("avx2")) return scanCsvBlockAvx2;
+#endif
+#if defined(ABCU_HAVE_NEON_CSV)
+    return scanCsvBlockNeon;
+#elif defined(ABCU_HAVE_SSE2_CSV)
+    return scanCsvBlockSse2;
+#else
+    return scanCsvBlockScalar;
+#endif
+}
+static const CsvBlockScanner scanCsvBlock = pickCsvScanner();
+
+// Bit i of the result is the XOR of bits 0..i: set for bytes after an odd
+// number of quotes in the block.
+static inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// True if the quote at data[at] can open a quoted field: only blanks sit
+// between it and the start of its field. `data` starts at a record boundary.
+static inline bool opensQuotedField(string_view data, size_t at) {
+    while (at > 0 && (data[at - 1] == ' ' || data[at - 1] == '\t')) --at;
+    return at == 0 || data[at - 1] == ',' || data[at - 1] == '\n';
+}
+
+// Walks `data` in 64-byte blocks (the last one zero-padded), calling
+// fn(base, masks, inQuotes) for each, with masks.quote holding only the
+// quotes that open, close or escape inside a quoted field. inQuotes carries
+// across blocks. Returns true if a quoted field is still open at the end.
+template <typename Fn>
+static inline bool scanCsvBlocks(string_view data, Fn fn) {
+    uint64_t carry = 0;          // all ones while a quoted field is open
+    size_t closedAt = SIZE_MAX;  // last closing quote; a quote right after it is an escape
+    alignas(64) char tail[64];
+    for (size_t base = 0; base < data.size(); base += 64) {
+        const char* p = data.data() + base;
+        if (data.size() - base < 64) {
+            memset(tail, 0, sizeof tail);
+            memcpy(tail, p, data.size() - base);
+            p = tail;
+        }
+        CsvBlockMasks m = scanCsvBlock(p);
+        if (m.quote) {
+            // quotes are rare next to commas and newlines: sort them one by one
+            uint64_t active = 0;
+            bool open = carry != 0;
+            for (uint64_t q = m.quote; q; q &= q - 1) {
+                size_t at = base + countTrailingZeros(q);
+                if (!open && at != closedAt + 1 && !opensQuotedField(data, at)) continue;
+                active |= q & -q;
+                if (open) closedAt = at;
+                open = !open;
+            }
+            m.quote = active;
+        }
+        uint64_t inQuotes = prefixXor(m.quote) ^ carry;
+        carry = (uint64_t)((int64_t)inQuotes >> 63);
+        fn(base, m, inQuotes);
+    }
+    return carry != 0;
+}
+
+// One raw CSV field. `raw` points into the line being parsed; fields that
+// contain quotes have to be unquoted before use (see fieldText).
+struct CsvField {
+    string_view raw;
+    bool hasQuotes = false;
+};
+
+// Minimal quote-aware CSV parser. Handles titles with commas like:
+// "CSCI200","Data Structures, with Labs",CSCI100
+// Fields are returned as views into `line`; `out` is reused between calls.
+// Returns false if a quoted field is never closed.
+static bool splitCSV(string_view line, vector<CsvField>& out) {
+    out.clear();
+    size_t start = 0;
+    bool sawQuote = false;
+    bool open = scanCsvBlocks(line, [&](size_t base, const CsvBlockMasks& m, uint64_t inQuotes) {
+        uint64_t quotes = m.quote;
+        for (uint64_t seps = m.comma & ~inQuotes; seps; seps &= seps - 1) {
+            uint64_t upTo = ((seps & -seps) << 1) - 1; // bits through this comma (0 - 1 = all at bit 63)
+            size_t at = base + countTrailingZeros(seps);
+            out.push_back({line.substr(start, at - start), sawQuote || (quotes & upTo)});
+            start = at + 1;
+            sawQuote = false;
+            quotes &= ~upTo;
+        }
+        sawQuote |= quotes != 0;
+    });
+    out.push_back({line.substr(start), sawQuote});
+    return !open;
+}
+
+// Trimmed text of a field. Unquoted fields are returned as-is (zero copy);
+// quoted ones are unescaped into `scratch`, which must outlive the result.
+// As in scanCsvBlocks, a quote after the closing one is plain text.
+static string_view fieldText(const CsvField& f, string& scratch) {
+    if (!f.hasQuotes) return trim(f.raw);
+    scratch.clear();
+    bool inQuotes = false, opened = false;
+    for (size_t i = 0; i < f.raw.size(); ++i) {
+        char ch = f.raw[i];
+        if (ch == '"' && inQuotes) {
+            if (i + 1 < f.raw.size() && f.raw[i + 1] == '"') {
+                scratch.push_back('"');
+                ++i;
+            } else {
+                inQuotes = false;
+            }
+        } else if (ch == '"' && !opened && trim(scratch).empty()) {
+            inQuotes = opened = true;
+        } else {
+            scratch.push_back(ch);
+        }
+    }
+    return trim(scratch);
+}
+
+// Read-only view of a whole file. Only regular files are mapped; anything
+// else (pipes, terminals, /dev/stdin) reports !ok() so callers can stream.
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+#ifdef ABCU_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            size_ = (size_t)st.st_size;
+            if (size_ == 0) {
+                ok_ = true;
+            } else {
+                void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    ::madvise(p, size_, MADV_SEQUENTIAL);
+                    data_ = static_cast<const char*>(p);
+                    ok_ = true;
+                }
+            }
+        }
+        ::close(fd);
+#else
+        (void)path;
+#endif
+    }
+    ~MappedFile() {
+#ifdef ABCU_HAVE_MMAP
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return ok_; }
+    string_view bytes() const { return string_view(data_, data_ ? size_ : 0); }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool ok_ = false;
+};
+
+static void printDivider() { cout << "----------------------------------------\n"; }
+
+// Output staging buffer for bulk results. Text is appended into one string
+// that is written to the stream a block at a time, so large outputs cost a
+// handful of write calls instead of one formatted insert per field.
+class OutputBuffer {
+public:
+    static const size_t kBlockBytes = 1u << 20;
+
+    explicit OutputBuffer(ostream& os) : os_(os) { buf_.reserve(kBlockBytes + 4096); }
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    string& str() { return buf_; }
+    OutputBuffer& operator<<(string_view s) { buf_.append(s); return *this; }
+    OutputBuffer& operator<<(char c) { buf_.push_back(c); return *this; }
+
+    // Call between records; writes once a full block has accumulated.
+    void maybeFlush() { if (buf_.size() >= kBlockBytes) flush(); }
+    void flush() {
+        ABCU_COUNT(bytesWritten, buf_.size());
+        if (!buf_.empty()) os_.write(buf_.data(), (streamsize)buf_.size());
+        buf_.clear();
+        os_.flush();
+    }
+
+private:
+    ostream& os_;
+    string buf_;
+};
+
+// Escapes for machine-readable output formats.
+static void appendTsvField(string& out, string_view s) {
+    for (char ch : s) {
+        switch (ch) {
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\\': out += "\\\\"; break;
+            default: out.push_back(ch);
+        }
+    }
+}
+static void appendJsonString(string& out, string_view s) {
+    static const char* hex = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : s) {
+        unsigned char u = (unsigned char)ch;
+        if (ch == '"' || ch == '\\') { out.push_back('\\'); out.push_back(ch); }
+        else if (ch == '\n') out += "\\n";
+        else if (ch == '\t') out += "\\t";
+        else if (ch == '\r') out += "\\r";
+        else if (u < 0x20) { out += "\\u00"; out.push_back(hex[u >> 4]); out.push_back(hex[u & 15]); }
+        else out.push_back(ch);
+    }
+    out.push_back('"');
+}
+
+// -----------------------------------------------------------------------------
+// Search index
+// -----------------------------------------------------------------------------
+// Typeahead over course IDs and titles.
+//  * IDs: sortedKeys is already in code order, so a prefix is one binary
+//    search plus a forward scan; no extra structure.
+//  * Titles: an inverted index from trigram to the titles containing it.
+//    Words are lowercased alphanumeric runs padded as "  word ", giving 37^3
+//    possible trigrams, so the index is a flat counting-sort CSR with no
+//    hashing.
+// Titles are ranked by Jaccard similarity of trigram sets. Posting lists hold
+// positions in rank order (fewest trigrams first, then code order), so among
+// titles that contain every query trigram the first ones found are the best:
+// the common typeahead case intersects the lists and stops after `limit`
+// hits. Only when that comes up short (typos) are shared trigrams counted
+// over the whole lists.
+class SearchIndex {
+public:
+    struct Hit {
+        CourseId id;
+        bool idPrefix;  // matched by code prefix rather than title
+        float score;    // title similarity in [0, 1]; 1 for ID matches
+    };
+
+    SearchIndex(const CourseTable& table, Span<CourseId> sortedKeys) : table_(table), sorted_(sortedKeys) {
+        // One pass in ID order (sequential in the arena) collects each
+        // title's distinct trigrams; every later step reads that buffer.
+        vector<uint16_t> gramBuf;          // trigrams fit 16 bits
+        vector<uint32_t> gramAt(table.idCount() + 1, 0);
+        vector<uint32_t> last(kTrigrams, kNoCourse);  // dedupes repeats in one title
+        start_.assign(kTrigrams + 1, 0);
+        for (CourseId id = 0; id < table.idCount(); ++id) {
+            if (table.isDefined(id)) {
+                forEachTrigram(table.title(id), true, [&](uint32_t g) {
+                    if (last[g] == id) return;
+                    last[g] = id;
+                    gramBuf.push_back((uint16_t)g);
+                    ++start_[g + 1];
+                });
+            }
+            gramAt[id + 1] = (uint32_t)gramBuf.size();
+        }
+        for (size_t g = 0; g < kTrigrams; ++g) start_[g + 1] += start_[g];
+
+        // rank order: by trigram count, stable, so code order breaks ties
+        auto gramsOf = [&](CourseId id) { return gramAt[id + 1] - gramAt[id]; };
+        size_t maxGrams = 0;
+        for (CourseId id : sorted_) maxGrams = max<size_t>(maxGrams, gramsOf(id));
+        vector<uint32_t> bucket(maxGrams + 2, 0);
+        for (CourseId id : sorted_) ++bucket[gramsOf(id) + 1];
+        for (size_t g = 1; g < bucket.size(); ++g) bucket[g] += bucket[g - 1];
+        order_.resize(sorted_.size());
+        gramCount_.resize(sorted_.size());
+        for (CourseId id : sorted_) {
+            uint32_t pos = bucket[gramsOf(id)]++;
+            order_[pos] = id;
+            gramCount_[pos] = (uint16_t)min<uint32_t>(gramsOf(id), UINT16_MAX);
+        }
+
+        // filling in rank order leaves every list sorted by position
+        postings_.resize(start_[kTrigrams]);
+        vector<uint32_t> cursor(start_.begin(), start_.end() - 1);
+        for (uint32_t pos = 0; pos < order_.size(); ++pos) {
+            CourseId id = order_[pos];
+            for (uint32_t i = gramAt[id]; i < gramAt[id + 1]; ++i) postings_[cursor[gramBuf[i]]++] = pos;
+        }
+    }
+
+    // Best `limit` matches for `query`: code-prefix matches first, in code
+    // order, then titles by similarity. A query without trailing whitespace is
+    // treated as still being typed, so its last word also matches longer words.
+    void search(string_view query, size_t limit, vector<Hit>& out) const {
+        out.clear();
+        if (limit == 0) return;
+        CourseCode code = normalizeCourseId(query);
+        if (!code.empty()) prefixMatches(code, limit, out);
+        if (out.size() < limit) titleMatches(query, limit, out);
+    }
+
+private:
+    static const uint32_t kAlphabet = 37;  // space, a-z, 0-9
+    static const uint32_t kTrigrams = kAlphabet * kAlphabet * kAlphabet;
+    static const size_t kMaxQueryGrams = 64;  // shared-trigram counts fit a uint8_t
+    static const uint32_t kWindow = 1u << 16; // positions counted per step of pass 2
+
+    static uint32_t symbol(char ch) {
+        if (ch >= 'a' && ch <= 'z') return 1 + (ch - 'a');
+        if (ch >= 'A' && ch <= 'Z') return 1 + (ch - 'A');
+        if (ch >= '0' && ch <= '9') return 27 + (ch - '0');
+        return 0;
+    }
+
+    // Calls fn(trigram) for every trigram of every word in `text`, in order.
+    // `padLast` = false leaves off the end-of-word trigram of the final word.
+    template <typename Fn>
+    static void forEachTrigram(string_view text, bool padLast, Fn fn) {
+        uint32_t a = 0, b = 0;  // the previous two symbols, 0 = word gap
+        bool inWord = false;
+        for (char ch : text) {
+            uint32_t c = symbol(ch);
+            if (c == 0 && !inWord) continue;
+            if (c == 0) {
+                fn((a * kAlphabet + b) * kAlphabet);  // "xy "
+                a = b = 0;
+                inWord = false;
+                continue;
+            }
+            fn((a * kAlphabet + b) * kAlphabet + c);
+            a = b;
+            b = c;
+            inWord = true;
+        }
+        if (inWord && padLast) fn((a * kAlphabet + b) * kAlphabet);
+    }
+
+    Span<uint32_t> postings(uint32_t g) const {
+        return {postings_.data() + start_[g], start_[g + 1] - start_[g]};
+    }
+
+    void prefixMatches(string_view prefix, size_t limit, vector<Hit>& out) const {
+        const CourseTable& t = table_;
+        const CourseId* it = lower_bound(sorted_.begin(), sorted_.end(), prefix,
+                                         [&](CourseId id, string_view p) { return t.number(id) < p; });
+        for (; it != sorted_.end() && out.size() < limit; ++it) {
+            if (t.number(*it).substr(0, prefix.size()) != prefix) break;
+            out.push_back({*it, true, 1.0f});
+        }
+    }
+
+    void titleMatches(string_view query, size_t limit, vector<Hit>& out) const {
+        bool typing = query.empty() || symbol(query.back()) != 0;
+        vector<uint32_t> grams;
+        forEachTrigram(query, !typing, [&](uint32_t g) { if (grams.size() < kMaxQueryGrams) grams.push_back(g); });
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+        if (grams.empty()) return;
+        sort(grams.begin(), grams.end(), [&](uint32_t x, uint32_t y) { return postings(x).size() < postings(y).size(); });
+        size_t n = grams.size();
+        size_t wanted = limit - out.size();
+        size_t idMatches = out.size();
+
+        // Pass 1: walk the rarest list in rank order and keep positions found
+        // in every other list. Each cursor only moves forward.
+        vector<const uint32_t*> cursor(n);
+        for (size_t k = 0; k < n; ++k) cursor[k] = postings(grams[k]).begin();
+        for (uint32_t pos : postings(grams[0])) {
+            bool all = true;
+            for (size_t k = 1; k < n && all; ++k) {
+                Span<uint32_t> list = postings(grams[k]);
+                cursor[k] = gallop(cursor[k], list.end(), pos);
+                all = cursor[k] != list.end() && *cursor[k] == pos;
+            }
+            if (all) addHit(pos, n, n, idMatches, out);
+            if (out.size() - idMatches == wanted) return;
+        }
+        if (n == 1) return;
+
+        // Pass 2, for typos: count shared trigrams and rank titles having at
+        // least two thirds of them. Counting runs over windows of positions;
+        // a title with g trigrams scores at most min(n, g) / max(n, g), and g
+        // only grows with position, so once that bound cannot beat the
+        // current best `wanted` hits the rest of the lists are skipped.
+        static thread_local vector<uint8_t> counts;
+        counts.assign(kWindow, 0);
+        out.resize(idMatches);
+        vector<Hit> hits;
+        vector<uint32_t> hitPos;
+        size_t minMatch = max<size_t>(1, (n * 2 + 2) / 3);
+        for (size_t k = 0; k < n; ++k) cursor[k] = postings(grams[k]).begin();
+        while (true) {
+            uint32_t w0 = UINT32_MAX;  // windows start at the next posting
+            for (size_t k = 0; k < n; ++k)
+                if (cursor[k] != postings(grams[k]).end()) w0 = min(w0, *cursor[k]);
+            if (w0 == UINT32_MAX) break;
+            uint32_t w1 = (uint32_t)min<size_t>(order_.size(), (size_t)w0 + kWindow);
+            for (size_t k = 0; k < n; ++k) {
+                const uint32_t* end = postings(grams[k]).end();
+                for (; cursor[k] != end && *cursor[k] < w1; ++cursor[k]) ++counts[*cursor[k] - w0];
+            }
+            for (uint32_t pos = w0; pos < w1; ++pos) {
+                uint8_t c = counts[pos - w0];
+                if (c >= minMatch && addHit(pos, c, n, idMatches, hits)) hitPos.push_back(pos);
+            }
+            fill(counts.begin(), counts.begin() + (w1 - w0), 0);
+
+            if (hits.size() < wanted || w1 == order_.size()) continue;
+            keepBest(hits, hitPos, wanted);
+            size_t g = gramCount_[w1];
+            if (g >= n && (float)n / (float)g <= hits.back().score) break;
+        }
+        keepBest(hits, hitPos, wanted);
+        out.insert(out.end(), hits.begin(), hits.end());
+    }
+
+    // Trims `hits` (and the parallel `pos`) to the best `keep`, best first;
+    // equal scores go to the earlier rank position.
+    static void keepBest(vector<Hit>& hits, vector<uint32_t>& pos, size_t keep) {
+        vector<uint32_t> idx(hits.size());
+        for (uint32_t i = 0; i < idx.size(); ++i) idx[i] = i;
+        keep = min(keep, idx.size());
+        partial_sort(idx.begin(), idx.begin() + keep, idx.end(), [&](uint32_t x, uint32_t y) {
+            if (hits[x].score != hits[y].score) return hits[x].score > hits[y].score;
+            return pos[x] < pos[y];
+        });
+        vector<Hit> bestHits(keep);
+        vector<uint32_t> bestPos(keep);
+        for (size_t i = 0; i < keep; ++i) {
+            bestHits[i] = hits[idx[i]];
+            bestPos[i] = pos[idx[i]];
+        }
+        hits.swap(bestHits);
+        pos.swap(bestPos);
+    }
+
+    static const uint32_t* gallop(const uint32_t* lo, const uint32_t* end, uint32_t target) {
+        size_t step = 1;
+        const uint32_t* hi = lo;
+        while (hi < end && *hi < target) {
+            lo = hi + 1;
+            hi = lo + min<size_t>(step, end - lo);
+            step *= 2;
+        }
+        return lower_bound(lo, hi, target);
+    }
+
+    // Scores by Jaccard similarity of the trigram sets. Skips titles already
+    // listed as one of the first `idMatches` code matches. Returns whether a
+    // hit was added.
+    bool addHit(uint32_t pos, size_t matched, size_t queryGrams, size_t idMatches, vector<Hit>& hits) const {
+        CourseId id = order_[pos];
+        for (size_t i = 0; i < idMatches && i < hits.size(); ++i)
+            if (hits[i].id == id) return false;
+        size_t titleGrams = max<size_t>(gramCount_[pos], matched);
+        hits.push_back({id, false, (float)matched / (float)(queryGrams + titleGrams - matched)});
+        return true;
+    }
+
+    const CourseTable& table_;
+    Span<CourseId> sorted_;
+    vector<CourseId> order_;      // rank position -> course
+    vector<uint16_t> gramCount_;  // by position: distinct trigrams in the title
+    vector<uint32_t> start_;      // kTrigrams + 1 offsets into postings_
+    vector<uint32_t> postings_;   // positions, ascending within each list
+};
+
+inline const SearchIndex& Catalog::search() const {
+    call_once(searchOnce_, [this] {
+        if (!searchIndex) searchIndex.reset(new SearchIndex(courses, sortedKeys.span()));
+    });
+    return *searchIndex;
+}
+
+// -----------------------------------------------------------------------------
+// Columnar view
+// -----------------------------------------------------------------------------
+// The catalog again with one contiguous array per field and rows in list
+// order: codes and titles packed back to back into two blobs with offset
+// arrays, prerequisite counts, a CSR of prerequisite rows, and per-row
+// fan-in and undefined-prerequisite counts. Whole-catalog scans (the course
+// list, --scan filters and aggregates) walk these front to back instead of
+// going through CourseIds to 28-byte records and the string arena, and the
+// per-column loops have no data-dependent branches, so they vectorize.
+class CourseColumns {
+public:
+    static constexpr uint32_t kNoRow = UINT32_MAX; // prerequisite that is not a listed course
+
+    CourseColumns(const CourseTable& table, Span<CourseId> order) {
+        size_t n = order.size();
+        vector<uint32_t> rowOf(table.idCount(), kNoRow);
+        size_t codeBytes = 0, titleBytes = 0, links = 0;
+        for (uint32_t r = 0; r < n; ++r) {
+            rowOf[order[r]] = r;
+            codeBytes += table.number(order[r]).size();
+            titleBytes += table.title(order[r]).size();
+            links += table.prereqs(order[r]).size();
+        }
+        if (codeBytes > UINT32_MAX || titleBytes > UINT32_MAX) throw length_error("course columns exceed 4 GiB");
+        ids_.assign(order.begin(), order.end());
+        codes_.reserve(codeBytes);
+        titles_.reserve(titleBytes);
+        prereqRows_.reserve(links);
+        codeOffsets_.resize(n + 1);
+        titleOffsets_.resize(n + 1);
+        prereqOffsets_.resize(n + 1);
+        prereqCounts_.resize(n);
+        fanIn_.assign(n, 0);
+        missing_.assign(n, 0);
+        for (uint32_t r = 0; r < n; ++r) {
+            CourseId id = order[r];
+            codeOffsets_[r] = (uint32_t)codes_.size();
+            codes_.append(table.number(id));
+            titleOffsets_[r] = (uint32_t)titles_.size();
+            titles_.append(table.title(id));
+            prereqOffsets_[r] = (uint32_t)prereqRows_.size();
+            prereqCounts_[r] = (uint32_t)table.prereqs(id).size();
+            for (CourseId p : table.prereqs(id)) {
+                uint32_t row = rowOf[p];
+                prereqRows_.push_back(row);
+                if (row == kNoRow) ++missing_[r];
+                else ++fanIn_[row];
+            }
+        }
+        codeOffsets_[n] = (uint32_t)codes_.size();
+        titleOffsets_[n] = (uint32_t)titles_.size();
+        prereqOffsets_[n] = (uint32_t)prereqRows_.size();
+    }
+
+    size_t size() const { return ids_.size(); }
+    CourseId id(uint32_t r) const { return ids_[r]; }
+    string_view code(uint32_t r) const {
+        return string_view(codes_).substr(codeOffsets_[r], codeOffsets_[r + 1] - codeOffsets_[r]);
+    }
+    string_view title(uint32_t r) const {
+        return string_view(titles_).substr(titleOffsets_[r], titleOffsets_[r + 1] - titleOffsets_[r]);
+    }
+    Span<uint32_t> prereqRows(uint32_t r) const {
+        return {prereqRows_.data() + prereqOffsets_[r], prereqOffsets_[r + 1] - prereqOffsets_[r]};
+    }
+
+    // Whole columns, one value per row.
+    Span<uint32_t> prereqCounts() const { return {prereqCounts_.data(), prereqCounts_.size()}; }
+    Span<uint32_t> fanIn() const { return {fanIn_.data(), fanIn_.size()}; }
+    Span<uint32_t> missing() const { return {missing_.data(), missing_.size()}; }
+    size_t linkCount() const { return prereqRows_.size(); }
+
+    size_t bytes() const {
+        return codes_.capacity() + titles_.capacity() +
+               (ids_.capacity() + codeOffsets_.capacity() + titleOffsets_.capacity() + prereqOffsets_.capacity() +
+                prereqRows_.capacity() + prereqCounts_.capacity() + fanIn_.capacity() + missing_.capacity()) *
+                   sizeof(uint32_t);
+    }
+
+private:
+    vector<CourseId> ids_;
+    string codes_, titles_;
+    vector<uint32_t> codeOffsets_, titleOffsets_; // size() + 1 each
+    vector<uint32_t> prereqOffsets_;              // size() + 1, into prereqRows_
+    vector<uint32_t> prereqRows_;                 // kNoRow for undefined prerequisites
+    vector<uint32_t> prereqCounts_;
+    vector<uint32_t> fanIn_;                      // listed courses naming the row as a prerequisite
+    vector<uint32_t> missing_;                    // undefined prerequisites of the row
+};
+
+inline const CourseColumns& Catalog::columns() const {
+    call_once(columnsOnce_, [this] {
+        if (!columnStore) columnStore.reset(new CourseColumns(courses, listOrder()));
+    });
+    return *columnStore;
+}
+
+// -----------------------------------------------------------------------------
+// Record parsing
+// -----------------------------------------------------------------------------
+// 64-bit hash of a trimmed source record, eight bytes at a time. Used to
+// spot changed rows on reload, so it only has to be fast and well mixed.
+static uint64_t hashRecord(string_view s) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    uint64_t h = s.size() * k;
+    size_t i = 0;
+    for (; i + 8 <= s.size(); i += 8) {
+        uint64_t w;
+        memcpy(&w, s.data() + i, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 29;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, s.data() + i, s.size() - i);
+    h = (h ^ tail) * k;
+    h ^= h >> 32;
+    return h | 1; // never 0, which means "no hash"
+}
+
+// Records a parse skipped, reported once it is done.
+struct SkippedRecords {
+    vector<size_t> malformed;                  // line numbers
+    vector<pair<size_t, size_t>> unterminated; // first and last line of records a quote left open
+
+    void append(const SkippedRecords& o, size_t lineBase) {
+        for (size_t ln : o.malformed) malformed.push_back(lineBase + ln);
+        for (auto r : o.unterminated) unterminated.push_back({lineBase + r.first, lineBase + r.second});
+    }
+};
+
+// Last line of the record `rec`, which starts on line `first`.
+static size_t lastLineOf(size_t first, string_view rec) {
+    return first + (size_t)count(rec.begin(), rec.end(), '\n');
+}
+
+// Reusable buffers for parsing one record at a time.
+struct LineParser {
+    vector<CsvField> fields;
+    string scratch;
+    CourseCode code;
+    vector<CourseId> prereqIds;
+    SkippedRecords skipped;
+#if ABCU_METRICS
+    PhaseSampler sampler;
+#endif
+};
+
+// Parse one (untrimmed) record into `table`. Strings are only copied here,
+// straight into the table's arena.
+static void parseCourseLine(string_view line, size_t lineNum, LineParser& lp, CourseTable& table) {
+    line = trim(line);
+    if (line.empty()) return;
+
+    ABCU_SAMPLE_BEGIN(lp.sampler);
+    if (!splitCSV(line, lp.fields)) {
+        // a quote left open to the end of the input took every line after it
+        lp.skipped.unterminated.push_back({lineNum, lastLineOf(lineNum, line)});
+        return;
+    }
+    if (lp.fields.size() < 2) {
+        lp.skipped.malformed.push_back(lineNum);
+        return;
+    }
+    ABCU_SAMPLE_LAP(lp.sampler, Split);
+
+    // every buffer here is reused from line to line, so a field costs no
+    // allocation unless it introduces a new code to the table
+    normalizeCourseId(fieldText(lp.fields[0], lp.scratch), lp.code);
+    if (lp.code.empty()) return;
+    ABCU_SAMPLE_LAP(lp.sampler, Normalize);
+    CourseId id = table.intern(lp.code);
+    ABCU_SAMPLE_LAP(lp.sampler, Insert);
+
+    lp.prereqIds.clear();
+    for (size_t i = 2; i < lp.fields.size(); ++i) {
+        normalizeCourseId(fieldText(lp.fields[i], lp.scratch), lp.code);
+        ABCU_SAMPLE_LAP(lp.sampler, Normalize);
+        if (!lp.code.empty()) lp.prereqIds.push_back(table.intern(lp.code));
+        ABCU_SAMPLE_LAP(lp.sampler, Insert);
+    }
+
+    // the title is looked up last: lp.scratch may back it
+    string_view title = fieldText(lp.fields[1], lp.scratch);
+    table.define(id, title, lp.prereqIds.data(), lp.prereqIds.size(), hashRecord(line));
+    ABCU_SAMPLE_LAP(lp.sampler, Insert);
+}
+
+// Calls fn(record, lineNum) for each record of `data`. A newline inside a
+// quoted field does not end the record, so quoted titles may span lines.
+// Returns the number of physical lines consumed; record line numbers start
+// at `firstLine`.
+template <typename Fn>
+static size_t forEachRecord(string_view data, size_t firstLine, Fn fn) {
+    size_t lineNum = firstLine;
+    size_t recStart = 0, recLine = firstLine;
+    scanCsvBlocks(data, [&](size_t base, const CsvBlockMasks& m, uint64_t inQuotes) {
+        uint64_t newlines = m.newline;
+        for (uint64_t ends = newlines & ~inQuotes; ends; ends &= ends - 1) {
+            uint64_t upTo = ((ends & -ends) << 1) - 1;
+            size_t at = base + countTrailingZeros(ends);
+            lineNum += popCount(newlines & upTo);
+            newlines &= ~upTo;
+            fn(data.substr(recStart, at - recStart), recLine);
+            recStart = at + 1;
+            recLine = lineNum;
+        }
+        lineNum += popCount(newlines); // newlines inside quoted fields
+    });
+    if (recStart < data.size()) {
+        // a final line without a newline, or a quoted field left open to EOF
+        bool endsWithNewline = data.back() == '\n';
+        fn(data.substr(recStart, data.size() - recStart - endsWithNewline), recLine);
+        if (!endsWithNewline) ++lineNum;
+    }
+    return lineNum - firstLine;
+}
+
+static size_t parseCourseBuffer(string_view data, size_t firstLine, LineParser& lp, CourseTable& table) {
+    return forEachRecord(data, firstLine,
+                         [&](string_view rec, size_t line) { parseCourseLine(rec, line, lp, table); });
+}
+
+// Offset just past the last record-ending newline of `data`, or 0 if no
+// record ends in it. `data` has to start at a record boundary.
+static size_t lastRecordEnd(string_view data) {
+    size_t end = 0;
+    scanCsvBlocks(data, [&](size_t base, const CsvBlockMasks& m, uint64_t inQuotes) {
+        for (uint64_t ends = m.newline & ~inQuotes; ends; ends &= ends - 1)
+            end = base + countTrailingZeros(ends) + 1;
+    });
+    return end;
+}
+
+// forEachRecord over a stream, one chunk at a time: memory stays at one
+// chunk unless a single record is longer. Returns false on a read error.
+static const size_t kStreamChunkBytes = 4u << 20;
+
+template <typename Fn>
+static bool forEachStreamRecord(istream& in, Fn fn) {
+    string buf(kStreamChunkBytes, '\0');
+    size_t have = 0, lineNum = 1;
+    while (true) {
+        if (have == buf.size()) buf.resize(buf.size() * 2);
+        in.read(&buf[have], (streamsize)(buf.size() - have));
+        size_t got = (size_t)in.gcount();
+        ABCU_COUNT(bytesRead, got);
+        have += got;
+        bool eof = got == 0;
+        string_view data(buf.data(), have);
+        size_t cut = eof ? have : lastRecordEnd(data);
+        if (cut) {
+            lineNum += forEachRecord(data.substr(0, cut), lineNum, fn);
+            memmove(&buf[0], buf.data() + cut, have - cut);
+            have -= cut;
+        }
+        if (eof) return !in.bad();
+    }
+}
+
+// Single-threaded load of inputs that are not mapped (pipes, stdin).
+static void parseCourseStream(istream& in, LineParser& lp, CourseTable& table) {
+    if (!forEachStreamRecord(in, [&](string_view rec, size_t line) { parseCourseLine(rec, line, lp, table); }))
+        throw runtime_error("read error");
+}
+
+// -----------------------------------------------------------------------------
+// Compressed input
+// -----------------------------------------------------------------------------
+// gzip and zstd catalogs are recognised by their magic bytes and decoded as
+// they are read, straight into the stream loaders: no temp file, and only a
+// compressed and a decoded chunk in memory at a time. Decoding needs
+// -DABCU_WITH_ZLIB (link -lz) or -DABCU_WITH_ZSTD (link -lzstd).
+enum class Compression { None, Gzip, Zstd };
+
+static Compression compressionOf(string_view head) {
+    if (head.size() >= 2 && head.substr(0, 2) == "\x1f\x8b") return Compression::Gzip;
+    if (head.size() >= 4 && head.substr(0, 4) == "\x28\xb5\x2f\xfd") return Compression::Zstd;
+    return Compression::None;
+}
+
+static const char* compressionName(Compression c) {
+    return c == Compression::Gzip ? "gzip" : c == Compression::Zstd ? "zstd" : "plain";
+}
+
+// The -D flag a build needs to read `c`, or nullptr if it already can.
+static const char* missingDecoderFlag(Compression c) {
+#ifndef ABCU_WITH_ZLIB
+    if (c == Compression::Gzip) return "-DABCU_WITH_ZLIB";
+#endif
+#ifndef ABCU_WITH_ZSTD
+    if (c == Compression::Zstd) return "-DABCU_WITH_ZSTD";
+#endif
+    (void)c;
+    return nullptr;
+}
+
+// Read-only streambuf over `src`, decoded according to the format of its
+// first bytes. Plain input passes through. Corrupt or truncated data throws
+// runtime_error, which istream rethrows to the reader (see CatalogInput).
+class DecodingBuf : public streambuf {
+public:
+    DecodingBuf() = default;
+    ~DecodingBuf() override {
+#ifdef ABCU_WITH_ZLIB
+        if (format_ == Compression::Gzip) inflateEnd(&z_);
+#endif
+#ifdef ABCU_WITH_ZSTD
+        if (zstd_) ZSTD_freeDStream(zstd_);
+#endif
+    }
+    DecodingBuf(const DecodingBuf&) = delete;
+    DecodingBuf& operator=(const DecodingBuf&) = delete;
+
+    // `head` holds the bytes already read from `src`. The format must be
+    // one this build decodes (missingDecoderFlag).
+    void start(istream& src, string_view head) {
+        src_ = &src;
+        format_ = compressionOf(head);
+        in_.assign(head.begin(), head.end());
+        if (format_ != Compression::None) in_.resize(max(kInputBytes, head.size()));
+        inLen_ = head.size();
+#ifdef ABCU_WITH_ZLIB
+        if (format_ == Compression::Gzip) {
+            z_ = z_stream();
+            if (inflateInit2(&z_, 15 + 16) != Z_OK) throw runtime_error("zlib initialisation failed");
+        }
+#endif
+#ifdef ABCU_WITH_ZSTD
+        if (format_ == Compression::Zstd && !(zstd_ = ZSTD_createDStream())) throw bad_alloc();
+#endif
+    }
+
+protected:
+    int_type underflow() override {
+        if (gptr() == egptr()) {
+            size_t n = decode(window_, sizeof window_);
+            setg(window_, window_, window_ + n);
+            if (n == 0) return traits_type::eof();
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // Large reads (the loaders ask for megabytes) decode straight into the
+    // caller's buffer.
+    streamsize xsgetn(char* s, streamsize n) override {
+        size_t want = (size_t)n, done = min(want, (size_t)(egptr() - gptr()));
+        if (done) {
+            memcpy(s, gptr(), done);
+            gbump((int)done);
+        }
+        while (done < want) {
+            size_t got = decode(s + done, want - done);
+            if (got == 0) break;
+            done += got;
+        }
+        return (streamsize)done;
+    }
+
+private:
+    static constexpr size_t kInputBytes = 1u << 20;
+
+    // Up to n decoded bytes; 0 only at the end of the input.
+    size_t decode(char* dst, size_t n) {
+        if (format_ == Compression::None) {
+            if (inPos_ < inLen_) {
+                size_t k = min(n, inLen_ - inPos_);
+                memcpy(dst, in_.data() + inPos_, k);
+                inPos_ += k;
+                return k;
+            }
+            src_->read(dst, (streamsize)n);
+            if (src_->bad()) throw runtime_error("read error");
+            return (size_t)src_->gcount();
+        }
+#ifdef ABCU_WITH_ZLIB
+        if (format_ == Compression::Gzip) return inflateInto(dst, n);
+#endif
+#ifdef ABCU_WITH_ZSTD
+        if (format_ == Compression::Zstd) return zstdInto(dst, n);
+#endif
+        throw runtime_error(string(compressionName(format_)) + " input is not supported by this build");
+    }
+
+    // Refills the compressed buffer once it has been consumed.
+    void fill() {
+        if (inPos_ < inLen_ || srcDone_) return;
+        src_->read(&in_[0], (streamsize)in_.size());
+        if (src_->bad()) throw runtime_error("read error");
+        inPos_ = 0;
+        inLen_ = (size_t)src_->gcount();
+        srcDone_ = !*src_;
+    }
+    bool inputDone() const { return inPos_ == inLen_ && srcDone_; }
+
+#ifdef ABCU_WITH_ZLIB
+    // Concatenated members (pigz, bgzip, `cat a.gz b.gz`) decode as one stream.
+    size_t inflateInto(char* dst, size_t n) {
+        z_.next_out = reinterpret_cast<Bytef*>(dst);
+        z_.avail_out = (uInt)min(n, (size_t)UINT32_MAX);
+        while (true) {
+            fill();
+            if (memberDone_ && inPos_ < inLen_) {
+                inflateReset(&z_);
+                memberDone_ = false;
+            }
+            if (!memberDone_) {
+                z_.next_in = reinterpret_cast<Bytef*>(&in_[inPos_]);
+                z_.avail_in = (uInt)(inLen_ - inPos_);
+                int rc = inflate(&z_, Z_NO_FLUSH);
+                inPos_ = inLen_ - z_.avail_in;
+                if (rc == Z_STREAM_END)
+                    memberDone_ = true;
+                else if (rc != Z_OK && rc != Z_BUF_ERROR)
+                    throw runtime_error(string("corrupt gzip data") + (z_.msg ? string(" (") + z_.msg + ")" : ""));
+            }
+            size_t produced = (size_t)(reinterpret_cast<char*>(z_.next_out) - dst);
+            if (produced) return produced;
+            if (inputDone()) {
+                if (!memberDone_) throw runtime_error("truncated gzip data");
+                return 0;
+            }
+        }
+    }
+#endif
+
+#ifdef ABCU_WITH_ZSTD
+    // Frames follow one another, as zstd itself writes multi-file output.
+    size_t zstdInto(char* dst, size_t n) {
+        ZSTD_outBuffer out{dst, n, 0};
+        while (true) {
+            fill();
+            ZSTD_inBuffer in{in_.data(), inLen_, inPos_};
+            size_t rc = ZSTD_decompressStream(zstd_, &out, &in);
+            if (ZSTD_isError(rc)) throw runtime_error(string("corrupt zstd data (") + ZSTD_getErrorName(rc) + ")");
+            // rc is 0 once a frame is complete; a call that makes no
+            // progress asks for the next frame instead
+            if (in.pos != inPos_ || out.pos) frameDone_ = rc == 0;
+            inPos_ = in.pos;
+            if (out.pos) return out.pos;
+            if (inputDone()) {
+                if (!frameDone_) throw runtime_error("truncated zstd data");
+                return 0;
+            }
+        }
+    }
+#endif
+
+    istream* src_ = nullptr;
+    Compression format_ = Compression::None;
+    string in_;              // compressed bytes, or the head of plain input
+    size_t inPos_ = 0, inLen_ = 0;
+    bool srcDone_ = false;
+    char window_[1 << 16];   // for character-at-a-time reads
+#ifdef ABCU_WITH_ZLIB
+    z_stream z_{};
+    bool memberDone_ = false;
+#endif
+#ifdef ABCU_WITH_ZSTD
+    ZSTD_DStream* zstd_ = nullptr;
+    bool frameDone_ = false;
+#endif
+};
+
+// A catalog file opened for one sequential read, decoded if compressed.
+// stream() throws on read errors and corrupt data instead of only setting
+// badbit, so loaders report why a read failed.
+class CatalogInput {
+public:
+    static const size_t kHeadBytes = 8;
+
+    CatalogInput() : stream_(&buf_) {}
+
+    // Prints the error to `diag` and returns false if `filename` cannot be
+    // opened or is compressed in a format this build cannot decode.
+    bool open(const string& filename, ostream& diag = cerr) {
+        file_.open(filename, ios::binary);
+        if (!file_) {
+            diag << "Error: could not open \"" << filename << "\".\n";
+            return false;
+        }
+        head_.resize(kHeadBytes);
+        file_.read(&head_[0], (streamsize)head_.size());
+        head_.resize((size_t)file_.gcount());
+        Compression c = compressionOf(head_);
+        if (const char* flag = missingDecoderFlag(c)) {
+            diag << "Error: \"" << filename << "\" is " << compressionName(c) << "-compressed; this build reads it only with "
+                 << flag << ".\n";
+            return false;
+        }
+        try {
+            buf_.start(file_, head_);
+        } catch (const exception& e) {
+            diag << "Error: could not open \"" << filename << "\": " << e.what() << ".\n";
+            return false;
+        }
+        stream_.exceptions(ios::badbit);
+        return true;
+    }
+
+    istream& stream() { return stream_; }
+    // First bytes of the file as stored (before decoding), for format checks.
+    string_view head() const { return head_; }
+    Compression compression() const { return compressionOf(head_); }
+
+private:
+    ifstream file_;
+    DecodingBuf buf_;
+    istream stream_;
+    string head_;
+};
+
+// -----------------------------------------------------------------------------
+// Parallel load
+// -----------------------------------------------------------------------------
+static const size_t kParallelLoadMinBytes = 8u << 20; // below this one thread wins
+
+// Run task(i) for i in [0, count) on up to `threads` workers.
+template <typename Fn>
+static void parallelFor(size_t count, unsigned threads, Fn task) {
+    if (threads <= 1 || count <= 1) {
+        for (size_t i = 0; i < count; ++i) task(i);
+        return;
+    }
+    atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < count;) task(i);
+    };
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads && t < count; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+// One chunk's rows, parsed into a table of its own.
+struct LoadShard {
+    CourseTable table;
+    LineParser lp;
+    size_t lines = 0;
+};
+
+static unsigned pickLoadThreads(const LoadOptions& opt, size_t bytes) {
+    if (opt.threads) return opt.threads;
+    if (bytes < kParallelLoadMinBytes) return 1;
+    unsigned hw = max(thread::hardware_concurrency(), 1u);
+    return opt.threadCap ? min(hw, opt.threadCap) : hw;
+}
+
+// Blocking FIFO with a fixed capacity. Items here are megabytes of input,
+// so one lock per item is noise next to the work it hands over.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(max<size_t>(capacity, 1)) {}
+
+    // Blocks while the queue is full; false once it is closed.
+    bool push(T item) {
+        unique_lock<mutex> lock(mutex_);
+        notFull_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(item));
+        notEmpty_.notify_one();
+        return true;
+    }
+    // Blocks while the queue is empty; false once it is closed and drained.
+    bool pop(T& item) {
+        unique_lock<mutex> lock(mutex_);
+        notEmpty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        item = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+    void close() {
+        lock_guard<mutex> lock(mutex_);
+        closed_ = true;
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    deque<T> items_;
+    mutex mutex_;
+    condition_variable notEmpty_, notFull_;
+    bool closed_ = false;
+};
+
+struct LoadChunk {
+    size_t seq = 0;
+    string buffer; // recycled between chunks, so it can be longer than `size`
+    size_t size = 0;
+};
+
+// Multi-threaded load as a pipeline: a reader thread cuts the stream into
+// record-aligned chunks, parser threads turn each chunk into a shard, and
+// the caller merges finished shards into `table` in file order (so a
+// duplicate course ID keeps the last row, as in the serial loader). Reads,
+// parsing and index insertion overlap, so a slow disk or network mount
+// stalls only the reader. At most `window` chunks are read but not yet
+// merged, which bounds memory whichever stage is slowest.
+static void parseCoursePipelined(istream& in, unsigned threads, LineParser& lp, CourseTable& table) {
+    const size_t window = (size_t)threads * 2;
+    BoundedQueue<LoadChunk> chunks(window);
+    vector<unique_ptr<LoadShard>> slots(window); // parsed chunk seq lands in slots[seq % window]
+    vector<string> spare;                         // buffers handed back by the parsers
+    mutex m;
+    condition_variable cv;
+    size_t merged = 0, total = 0;
+    bool readerDone = false;
+    exception_ptr error;
+
+    auto fail = [&](exception_ptr e) {
+        {
+            lock_guard<mutex> lock(m);
+            if (!error) error = e;
+        }
+        chunks.close();
+        cv.notify_all();
+    };
+    auto takeBuffer = [&] {
+        lock_guard<mutex> lock(m);
+        string b;
+        if (!spare.empty()) {
+            b.swap(spare.back());
+            spare.pop_back();
+        }
+        return b;
+    };
+
+    auto parser = [&] {
+        LoadChunk c;
+        while (chunks.pop(c)) {
+            auto sh = make_unique<LoadShard>();
+            try {
+                sh->table.reserveBytes(c.size);
+                sh->lines = parseCourseBuffer(string_view(c.buffer.data(), c.size), 1, sh->lp, sh->table);
+            } catch (...) {
+                fail(current_exception());
+            }
+            lock_guard<mutex> lock(m);
+            slots[c.seq % window] = std::move(sh);
+            spare.push_back(std::move(c.buffer));
+            cv.notify_all();
+        }
+    };
+
+    // Parsers start as chunks arrive, so small input never spawns more
+    // threads than it has chunks.
+    thread reader([&] {
+        vector<thread> parsers;
+        try {
+            string buf = takeBuffer();
+            size_t have = 0;
+            for (size_t seq = 0;; ++seq) {
+                {
+                    unique_lock<mutex> lock(m);
+                    cv.wait(lock, [&] { return error || seq < merged + window; });
+                    if (error) break;
+                }
+                bool eof = false;
+                size_t cut = 0;
+                while (true) {
+                    if (buf.size() < kStreamChunkBytes) buf.resize(kStreamChunkBytes);
+                    if (have == buf.size()) buf.resize(buf.size() * 2); // one record longer than the buffer
+                    {
+                        ABCU_TIME_PHASE(Read);
+                        in.read(&buf[have], (streamsize)(buf.size() - have));
+                    }
+                    ABCU_COUNT(bytesRead, in.gcount());
+                    have += (size_t)in.gcount();
+                    if (in.bad()) throw runtime_error("read error");
+                    eof = !in;
+                    cut = eof ? have : lastRecordEnd(string_view(buf.data(), have));
+                    if (cut || eof) break;
+                }
+                string next = takeBuffer();
+                if (next.size() < have - cut) next.resize(have - cut);
+                memcpy(&next[0], buf.data() + cut, have - cut);
+                if (cut) {
+                    if (parsers.size() < threads) parsers.emplace_back(parser);
+                    if (!chunks.push(LoadChunk{seq, std::move(buf), cut})) break;
+                    lock_guard<mutex> lock(m);
+                    total = seq + 1;
+                }
+                buf.swap(next);
+                have -= cut;
+                if (eof) break;
+            }
+        } catch (...) {
+            fail(current_exception());
+        }
+        chunks.close();
+        for (thread& th : parsers) th.join();
+        lock_guard<mutex> lock(m);
+        readerDone = true;
+        cv.notify_all();
+    });
+
+    size_t lineBase = 0;
+    for (size_t seq = 0;; ++seq) {
+        unique_ptr<LoadShard> sh;
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] { return error || slots[seq % window] || (readerDone && seq >= total); });
+            if (error || !slots[seq % window]) break;
+            sh = std::move(slots[seq % window]);
+        }
+        {
+            ABCU_TIME_PHASE(Merge);
+#if ABCU_METRICS
+            sh->lp.sampler.mergeInto(lp.sampler);
+#endif
+            lp.skipped.append(sh->lp.skipped, lineBase);
+            lineBase += sh->lines;
+            if (table.empty()) table.swap(sh->table);
+            else table.mergeFrom(sh->table);
+            sh.reset();
+        }
+        lock_guard<mutex> lock(m);
+        merged = seq + 1;
+        cv.notify_all();
+    }
+    reader.join();
+    if (error) rethrow_exception(error);
+}
+
+// -----------------------------------------------------------------------------
+// Work-stealing thread pool
+// -----------------------------------------------------------------------------
+// Persistent workers for batch jobs with uneven items (one student's plan
+// can touch ten courses or ten thousand). parallelFor deals [0, count) out
+// as grain-sized ranges, a contiguous block per worker; a worker takes
+// ranges from the back of its own deque and, once that is empty, steals
+// from the front of the others', so slow blocks get shared instead of
+// leaving the rest of the pool idle. The caller works as worker 0.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned threads) : queues_(max(threads, 1u)) {
+        for (unsigned t = 1; t < queues_.size(); ++t) workers_.emplace_back([this, t] { workerLoop(t); });
+    }
+    ~WorkStealingPool() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (thread& th : workers_) th.join();
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return (unsigned)queues_.size(); }
+
+    // Runs task(i) for every i in [0, count) and waits for all of them. Not
+    // reentrant: a task must not call parallelFor on the same pool.
+    void parallelFor(size_t count, const function<void(size_t)>& task, size_t grain = 16) {
+        size_t n = queues_.size(), per = (count + n - 1) / n;
+        for (size_t q = 0; q < n; ++q) {
+            size_t end = min(count, (q + 1) * per);
+            for (size_t begin = q * per; begin < end; begin += grain)
+                queues_[q].ranges.push_back({begin, min(end, begin + grain)});
+        }
+        {
+            lock_guard<mutex> lock(mutex_);
+            task_ = &task;
+            busy_ = (unsigned)workers_.size();
+            ++generation_;
+        }
+        wake_.notify_all();
+        drain(0);
+        unique_lock<mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    using Range = pair<size_t, size_t>;
+    struct alignas(64) Queue {
+        mutex lock;
+        deque<Range> ranges;
+    };
+
+    void workerLoop(unsigned self) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            drain(self);
+            lock_guard<mutex> lock(mutex_);
+            if (--busy_ == 0) done_.notify_one();
+        }
+    }
+
+    // Works until every queue is empty. No ranges are added while a job
+    // runs, so one empty sweep means the job has been handed out.
+    void drain(unsigned self) {
+        const function<void(size_t)>& task = *task_;
+        Range r;
+        while (take(self, r))
+            for (size_t i = r.first; i < r.second; ++i) task(i);
+    }
+
+    bool take(unsigned self, Range& r) {
+        {
+            Queue& own = queues_[self];
+            lock_guard<mutex> lock(own.lock);
+            if (!own.ranges.empty()) {
+                r = own.ranges.back();
+                own.ranges.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            Queue& victim = queues_[(self + k) % queues_.size()];
+            lock_guard<mutex> lock(victim.lock);
+            if (!victim.ranges.empty()) {
+                r = victim.ranges.front();
+                victim.ranges.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    vector<Queue> queues_;
+    vector<thread> workers_;
+    mutex mutex_;
+    condition_variable wake_, done_;
+    const function<void(size_t)>* task_ = nullptr;
+    uint64_t generation_ = 0;
+    unsigned busy_ = 0;
+    bool stop_ = false;
+};
+
+// -----------------------------------------------------------------------------
+// Binary snapshots (--save-snapshot / --load-snapshot)
+// -----------------------------------------------------------------------------
+// A snapshot is the loaded catalog's arrays written back to back: string
+// arena, Course records, prerequisite pool, flat index, sorted order. Every
+// array is position independent (offsets and CourseIds, no pointers), so
+// loading one maps the file and points the table at it; nothing is parsed
+// or rebuilt. Snapshots are native-endian and tied to the struct layouts
+// below, both of which the header records.
+static const char kSnapshotMagic[8] = {'A', 'B', 'C', 'U', 'S', 'N', 'A', 'P'};
+static const uint32_t kSnapshotVersion = 2;
+static const uint32_t kSnapshotByteOrder = 0x01020304;
+static const size_t kSnapshotAlign = 64;
+
+struct SnapshotSection {
+    uint64_t offset; // from start of file, kSnapshotAlign aligned
+    uint64_t count;  // elements
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t courseSize;  // sizeof(Course) when written
+    uint32_t hasIndex;    // 1 if indexCtrl/indexSlots hold a FlatCourseIndex
+    uint32_t codeFormat;  // CodeFormat::kTag of the index's packed keys
+    uint32_t reserved;
+    uint64_t definedCount;
+    uint64_t indexSize;
+    SnapshotSection strings, courses, prereqs, indexCtrl, indexSlots, sortedKeys;
+};
+
+static bool isSnapshot(string_view bytes) {
+    return bytes.size() >= sizeof(SnapshotHeader) && memcmp(bytes.data(), kSnapshotMagic, 8) == 0;
+}
+
+static bool saveSnapshot(const Catalog& catalog, const string& filename) {
+    ofstream out(filename, ios::binary | ios::trunc);
+    if (!out) {
+        cerr << "Error: could not create \"" << filename << "\".\n";
+        return false;
+    }
+
+    const CourseTable& table = catalog.courses;
+    SnapshotHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, kSnapshotMagic, 8);
+    h.version = kSnapshotVersion;
+    h.byteOrder = kSnapshotByteOrder;
+    h.courseSize = sizeof(Course);
+    h.definedCount = table.size();
+
+    // lay sections out first so the header can be written up front
+    uint64_t pos = sizeof(SnapshotHeader);
+    auto place = [&](SnapshotSection& sec, size_t count, size_t elemSize) {
+        pos = (pos + kSnapshotAlign - 1) / kSnapshotAlign * kSnapshotAlign;
+        sec = {pos, count};
+        pos += count * elemSize;
+    };
+    place(h.strings, table.stringBytes().size(), 1);
+    place(h.courses, table.courseRecords().size(), sizeof(Course));
+    place(h.prereqs, table.prereqPool().size(), sizeof(CourseId));
+#ifndef ABCU_STD_COURSE_INDEX
+    h.hasIndex = 1;
+    h.codeFormat = CodeFormat::kTag;
+    h.indexSize = table.index().size();
+    place(h.indexCtrl, table.index().ctrlBytes().size(), 1);
+    place(h.indexSlots, table.index().slotArray().size(), sizeof(FlatCourseIndex::Slot));
+#endif
+    place(h.sortedKeys, catalog.sortedKeys.size(), sizeof(CourseId));
+
+    uint64_t written = 0;
+    auto write = [&](const SnapshotSection& sec, const void* data, size_t bytes) {
+        static const char zeros[kSnapshotAlign] = {};
+        out.write(zeros, (streamsize)(sec.offset - written));
+        out.write(static_cast<const char*>(data), (streamsize)bytes);
+        written = sec.offset + bytes;
+    };
+    out.write(reinterpret_cast<const char*>(&h), sizeof h);
+    written = sizeof h;
+    write(h.strings, table.stringBytes().ptr, table.stringBytes().size());
+    write(h.courses, table.courseRecords().ptr, table.courseRecords().size() * sizeof(Course));
+    write(h.prereqs, table.prereqPool().ptr, table.prereqPool().size() * sizeof(CourseId));
+#ifndef ABCU_STD_COURSE_INDEX
+    write(h.indexCtrl, table.index().ctrlBytes().ptr, table.index().ctrlBytes().size());
+    write(h.indexSlots, table.index().slotArray().ptr,
+          table.index().slotArray().size() * sizeof(FlatCourseIndex::Slot));
+#endif
+    write(h.sortedKeys, catalog.sortedKeys.data(), catalog.sortedKeys.size() * sizeof(CourseId));
+
+    out.close();
+    if (!out) {
+        cerr << "Error: could not write \"" << filename << "\".\n";
+        return false;
+    }
+    return true;
+}
+
+// Points `table` and `sortedKeys` into the mapped snapshot. The checks below
+// are a read-only sweep that keeps a truncated or foreign file from being
+// used; they allocate nothing and copy nothing.
+static bool borrowSnapshot(shared_ptr<const MappedFile> file, CourseTable& table, PodArray<CourseId>& sortedKeys,
+                           string& error) {
+    string_view bytes = file->bytes();
+    SnapshotHeader h;
+    memcpy(&h, bytes.data(), sizeof h);
+    if (h.version != kSnapshotVersion) { error = "unsupported snapshot version"; return false; }
+    if (h.byteOrder != kSnapshotByteOrder || h.courseSize != sizeof(Course)) {
+        error = "snapshot was written on an incompatible build";
+        return false;
+    }
+
+    auto section = [&](const SnapshotSection& sec, size_t elemSize, const void*& data) {
+        if (sec.offset % kSnapshotAlign || sec.offset > bytes.size() ||
+            sec.count > (bytes.size() - sec.offset) / elemSize)
+            return false;
+        data = bytes.data() + sec.offset;
+        return true;
+    };
+    const void *strings, *courses, *prereqs, *keys, *ctrl = nullptr, *slots = nullptr;
+    if (!section(h.strings, 1, strings) || !section(h.courses, sizeof(Course), courses) ||
+        !section(h.prereqs, sizeof(CourseId), prereqs) || !section(h.sortedKeys, sizeof(CourseId), keys) ||
+        (h.hasIndex && (!section(h.indexCtrl, 1, ctrl) ||
+                        !section(h.indexSlots, sizeof(FlatCourseIndex::Slot), slots)))) {
+        error = "snapshot is truncated";
+        return false;
+    }
+
+    Span<Course> recs{static_cast<const Course*>(courses), h.courses.count};
+    Span<CourseId> pool{static_cast<const CourseId*>(prereqs), h.prereqs.count};
+    Span<CourseId> order{static_cast<const CourseId*>(keys), h.sortedKeys.count};
+    size_t n = recs.size(), defined = 0;
+    auto strOk = [&](StrRef r) { return r.offset <= h.strings.count && r.length <= h.strings.count - r.offset; };
+    for (const Course& c : recs) {
+        defined += c.defined;
+        if (!strOk(c.number) || !strOk(c.title) || c.prereqBegin > pool.size() ||
+            c.prereqCount > pool.size() - c.prereqBegin) {
+            error = "snapshot is corrupt";
+            return false;
+        }
+    }
+    bool idsOk = defined == h.definedCount && order.size() == defined;
+    for (CourseId id : pool) idsOk = idsOk && id < n;
+    for (CourseId id : order) idsOk = idsOk && id < n && recs[id].defined;
+    if (!idsOk) {
+        error = "snapshot is corrupt";
+        return false;
+    }
+
+    table.borrow(file, {static_cast<const char*>(strings), h.strings.count}, recs, pool, defined);
+    sortedKeys.borrow(order.ptr, order.size());
+#ifndef ABCU_STD_COURSE_INDEX
+    // an index keyed for another code shape is rebuilt rather than refused
+    if (h.hasIndex && h.codeFormat == CodeFormat::kTag) {
+        Span<uint8_t> c{static_cast<const uint8_t*>(ctrl), h.indexCtrl.count};
+        Span<FlatCourseIndex::Slot> s{static_cast<const FlatCourseIndex::Slot*>(slots), h.indexSlots.count};
+        bool ok = c.size() == s.size() && c.size() % 16 == 0 && (c.size() & (c.size() - 1)) == 0 &&
+                  h.indexSize == n && (c.size() || !n);
+        for (size_t i = 0; ok && i < c.size(); ++i) ok = (c[i] & 0x80) || s[i].id < n;
+        if (!ok) {
+            error = "snapshot index is corrupt";
+            return false;
+        }
+        table.mutableIndex().borrow(c, s, h.indexSize);
+        return true;
+    }
+#endif
+    table.rebuildIndex();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Course ordering
+// -----------------------------------------------------------------------------
+// sortedKeys is in byte order of the normalized codes; with --order natural
+// the list order comes from precomputed collation keys that sort the same
+// way. Either way courses are sorted by a byte-string key: eight bytes at a
+// time are packed big-endian into an integer and MSD radix sorted a byte per
+// pass, skipping bytes every key in a bucket shares; keys still tied after
+// eight bytes are re-keyed on the next eight. Small buckets fall back to
+// comparing the integers. Large tables are split on the top sixteen
+// distinguishing bits first and the buckets sorted in parallel.
+// -DABCU_STD_SORT keeps a plain comparison sort.
+static const size_t kParallelSortMin = 1u << 16;  // fewer keys sort faster on one thread
+static const size_t kRadixCutoff = 48;             // comparison sort below this
+
+#ifdef ABCU_STD_SORT
+// Sorts `ids` by keyOf(id), a string_view.
+template <typename KeyOf>
+static void sortByKey(vector<CourseId>& ids, unsigned /*threads*/, const KeyOf& keyOf) {
+    sort(ids.begin(), ids.end(), [&](CourseId a, CourseId b) { return keyOf(a) < keyOf(b); });
+}
+#else
+struct PrefixKey {
+    uint64_t key;
+    CourseId id;
+};
+
+static inline uint64_t prefixKey8(string_view s) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < s.size() && i < 8; ++i) k |= (uint64_t)(unsigned char)s[i] << (56 - 8 * i);
+    return k;
+}
+
+// Key bits (counted from bit 0) where not every key of a[0, n) agrees,
+// restricted to those below `bits`.
+static inline uint64_t differingBits(const PrefixKey* a, size_t n, unsigned bits) {
+    uint64_t diff = 0;
+    for (size_t i = 1; i < n; ++i) diff |= a[i].key ^ a[0].key;
+    return bits >= 64 ? diff : diff & ((1ull << bits) - 1);
+}
+
+// Sorts a[0, n), whose full keys agree before byte `depth` and whose packed
+// keys (key bytes from `depth` on) agree above bit `bits`; `tmp` is scratch
+// of the same size.
+template <typename KeyOf>
+static void radixSortPrefixKeys(PrefixKey* a, PrefixKey* tmp, size_t n, unsigned bits, size_t depth,
+                                const KeyOf& keyOf) {
+    uint64_t diff = n < kRadixCutoff ? 0 : differingBits(a, n, bits);
+    if (diff == 0) {
+        sort(a, a + n, [](const PrefixKey& x, const PrefixKey& y) { return x.key < y.key; });
+        // runs tied on all eight bytes go on to the next eight (a shorter
+        // key reads as zero bytes, so it comes first)
+        for (size_t i = 0, j; i < n; i = j) {
+            for (j = i + 1; j < n && a[j].key == a[i].key;) ++j;
+            if (j - i < 2) continue;
+            bool longer = false;
+            for (size_t k = i; k < j; ++k) {
+                string_view key = keyOf(a[k].id);
+                longer |= key.size() > depth + 8;
+                a[k].key = prefixKey8(key.substr(min(key.size(), depth + 8)));
+            }
+            if (longer) {
+                radixSortPrefixKeys(a + i, tmp + i, j - i, 64, depth + 8, keyOf);
+            } else {
+                // every key has ended, and those that differ only in trailing
+                // NUL bytes would tie at any depth: compare them whole
+                sort(a + i, a + j, [&](const PrefixKey& x, const PrefixKey& y) { return keyOf(x.id) < keyOf(y.id); });
+            }
+        }
+        return;
+    }
+    unsigned shift = (63 - countLeadingZeros(diff)) / 8 * 8;
+    size_t start[257] = {};
+    for (size_t i = 0; i < n; ++i) ++start[((a[i].key >> shift) & 0xFF) + 1];
+    for (size_t b = 0; b < 256; ++b) start[b + 1] += start[b];
+    size_t pos[256];
+    memcpy(pos, start, sizeof pos);
+    for (size_t i = 0; i < n; ++i) tmp[pos[(a[i].key >> shift) & 0xFF]++] = a[i];
+    memcpy(a, tmp, n * sizeof(PrefixKey));
+    for (size_t b = 0; b < 256; ++b)
+        if (start[b + 1] - start[b] > 1)
+            radixSortPrefixKeys(a + start[b], tmp + start[b], start[b + 1] - start[b], shift, depth, keyOf);
+}
+
+template <typename KeyOf>
+static void radixSortPrefixKeysParallel(vector<PrefixKey>& a, unsigned threads, const KeyOf& keyOf) {
+    const size_t kBuckets = 1u << 16;
+    size_t n = a.size();
+    uint64_t diff = differingBits(a.data(), n, 64);
+    unsigned top = diff ? 63 - countLeadingZeros(diff) : 0;
+    unsigned shift = top >= 16 ? (top - 15 + 7) / 8 * 8 : 0; // lowest byte-aligned digit holding `top`
+    auto digit = [shift](const PrefixKey& k) { return (size_t)((k.key >> shift) & (kBuckets - 1)); };
+
+    // per-chunk histograms, then a stable scatter from each chunk's offsets
+    size_t chunks = threads, per = (n + chunks - 1) / chunks;
+    vector<vector<size_t>> offsets(chunks, vector<size_t>(kBuckets));
+    parallelFor(chunks, threads, [&](size_t c) {
+        for (size_t i = c * per; i < min(n, (c + 1) * per); ++i) ++offsets[c][digit(a[i])];
+    });
+    vector<size_t> start(kBuckets + 1);
+    for (size_t b = 0, sum = 0; b < kBuckets; ++b) {
+        start[b] = sum;
+        for (size_t c = 0; c < chunks; ++c) {
+            size_t count = offsets[c][b];
+            offsets[c][b] = sum;
+            sum += count;
+        }
+    }
+    start[kBuckets] = n;
+    vector<PrefixKey> tmp(n);
+    parallelFor(chunks, threads, [&](size_t c) {
+        vector<size_t>& pos = offsets[c];
+        for (size_t i = c * per; i < min(n, (c + 1) * per); ++i) tmp[pos[digit(a[i])]++] = a[i];
+    });
+
+    vector<size_t> buckets;
+    for (size_t b = 0; b < kBuckets; ++b)
+        if (start[b + 1] - start[b] > 1) buckets.push_back(b);
+    parallelFor(buckets.size(), threads, [&](size_t i) {
+        size_t b = buckets[i];
+        radixSortPrefixKeys(tmp.data() + start[b], a.data() + start[b], start[b + 1] - start[b], shift, 0, keyOf);
+    });
+    a.swap(tmp);
+}
+
+// Sorts `ids` by keyOf(id), a string_view; keys of distinct IDs must differ.
+template <typename KeyOf>
+static void sortByKey(vector<CourseId>& ids, unsigned threads, const KeyOf& keyOf) {
+    vector<PrefixKey> keys(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) keys[i] = {prefixKey8(keyOf(ids[i])), ids[i]};
+    if (threads > 1 && keys.size() >= kParallelSortMin) {
+        radixSortPrefixKeysParallel(keys, threads, keyOf);
+    } else {
+        vector<PrefixKey> tmp(keys.size());
+        radixSortPrefixKeys(keys.data(), tmp.data(), keys.size(), 64, 0, keyOf);
+    }
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = keys[i].id;
+}
+#endif
+
+static unsigned sortThreads(const LoadOptions& opt) {
+    if (opt.threads) return opt.threads;
+    unsigned hw = max(thread::hardware_concurrency(), 1u);
+    return opt.threadCap ? min(hw, opt.threadCap) : hw;
+}
+
+// Sorts `ids` by course code, the order of sortedKeys.
+static void sortByCode(const CourseTable& table, vector<CourseId>& ids, unsigned threads = 1) {
+    sortByKey(ids, threads, [&](CourseId id) { return table.number(id); });
+}
+
+// Appends the natural-order collation key of `code`: comparing keys bytewise
+// orders codes by their letters and then by the value of each digit run, so
+// CSCI200 comes before CSCI1000. A digit run becomes '0', its significant
+// digit count and those digits ('0' keeps runs below letters, as in code
+// order); a NUL and the code itself then break ties like CSCI0200/CSCI200.
+static void appendNaturalKey(string_view code, string& out) {
+    for (size_t i = 0; i < code.size();) {
+        if (code[i] < '0' || code[i] > '9') {
+            out.push_back(code[i++]);
+            continue;
+        }
+        size_t run = i;
+        while (run < code.size() && code[run] == '0') ++run;  // leading zeros
+        size_t end = run;
+        while (end < code.size() && code[end] >= '0' && code[end] <= '9') ++end;
+        out.push_back('0');
+        out.push_back((char)min<size_t>(end - run, 255));
+        out.append(code.substr(run, end - run));
+        i = end;
+    }
+    out.push_back('\0');
+    out.append(code);
+}
+
+static void buildNaturalKeys(const CourseTable& table, CollationKeys& keys) {
+    keys.bytes.clear();
+    keys.offsets.assign(table.idCount() + 1, 0);
+    for (CourseId id = 0; id < table.idCount(); ++id) {
+        if (table.isDefined(id)) appendNaturalKey(table.number(id), keys.bytes);
+        keys.offsets[id + 1] = (uint32_t)keys.bytes.size();
+    }
+}
+
+// `old` with `removed` IDs dropped and `added` (unsorted) merged in, by keyOf.
+template <typename KeyOf>
+static vector<CourseId> patchOrder(Span<CourseId> old, const vector<bool>& removed, vector<CourseId> added,
+                                   const KeyOf& keyOf) {
+    vector<CourseId> kept;
+    kept.reserve(old.size());
+    for (CourseId id : old)
+        if (!removed[id]) kept.push_back(id);
+    sortByKey(added, 1, keyOf);
+    vector<CourseId> keys(kept.size() + added.size());
+    merge(kept.begin(), kept.end(), added.begin(), added.end(), keys.begin(),
+          [&](CourseId a, CourseId b) { return keyOf(a) < keyOf(b); });
+    return keys;
+}
+
+// Sets the list order of a catalog whose sortedKeys are in place. `previous`
+// (optional) is the catalog being reloaded: with the same order, its natural
+// order is patched like sortedKeys instead of re-sorted.
+static void applyListOrder(Catalog& catalog, CourseOrder order, unsigned threads, const Catalog* previous = nullptr,
+                           const vector<bool>* removed = nullptr, const vector<CourseId>* added = nullptr) {
+    catalog.order = order;
+    catalog.naturalOrder.clear();
+    catalog.naturalKeys = CollationKeys();
+    if (order != CourseOrder::Natural) return;
+    ABCU_TIME_PHASE(Sort);
+    buildNaturalKeys(catalog.courses, catalog.naturalKeys);
+    auto keyOf = [&](CourseId id) { return catalog.naturalKeys.of(id); };
+    if (previous && previous->order == CourseOrder::Natural && removed && added) {
+        catalog.naturalOrder.adopt(patchOrder(previous->naturalOrder.span(), *removed, *added, keyOf));
+    } else {
+        vector<CourseId> ids(catalog.sortedKeys.begin(), catalog.sortedKeys.end());
+        sortByKey(ids, threads, keyOf);
+        catalog.naturalOrder.adopt(std::move(ids));
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Load validation
+// -----------------------------------------------------------------------------
+// What is wrong with a loaded CSV, gathered into one report: counts plus
+// the first few examples of each problem. A warning per line used to be the
+// slowest part of loading a dirty file.
+struct ValidationReport {
+    static const size_t kExamples = 5;
+
+    struct Problem {
+        size_t count = 0;
+        vector<string> examples; // the first kExamples
+
+        // Counts one; true if the caller should add its example.
+        bool note() { return count++ < kExamples; }
+        void mergeFrom(Problem& o) {
+            count += o.count;
+            for (string& e : o.examples)
+                if (examples.size() < kExamples) examples.push_back(std::move(e));
+        }
+    };
+
+    Problem malformed;  // line numbers; the rows were skipped
+    Problem unterminated; // line ranges of records a quote left open; skipped
+    Problem duplicates; // codes defined more than once; the last row wins
+    Problem selfRefs;   // courses listing themselves
+    Problem undefined;  // prerequisite codes no row defines
+    size_t undefinedRefs = 0;
+    Problem cycles;
+
+    void noteSkipped(const SkippedRecords& s) {
+        for (size_t ln : s.malformed)
+            if (malformed.note()) malformed.examples.push_back(to_string(ln));
+        for (auto r : s.unterminated)
+            if (unterminated.note()) unterminated.examples.push_back(to_string(r.first) + "-" + to_string(r.second));
+    }
+
+    bool clean() const {
+        return !malformed.count && !unterminated.count && !duplicates.count && !selfRefs.count && !undefined.count && !cycles.count;
+    }
+
+    // One warning block for `source`; empty when clean.
+    string render(const string& source) const {
+        string out;
+        if (clean()) return out;
+        out.append("Warning: problems in \"").append(source).append("\":\n");
+        auto line = [&](const Problem& p, const string& label, const char* sep) {
+            if (!p.count) return;
+            out.append("  ").append(to_string(p.count)).append(" ").append(label).append(": ");
+            for (size_t i = 0; i < p.examples.size(); ++i) out.append(i ? sep : "").append(p.examples[i]);
+            out.append(p.count > p.examples.size() ? string(sep) + "...\n" : "\n");
+        };
+        line(malformed, "malformed lines (skipped), at lines", ", ");
+        line(unterminated, "records with an unterminated quote (skipped), at lines", ", ");
+        line(duplicates, "courses defined more than once (last row wins)", ", ");
+        line(selfRefs, "courses listing themselves as a prerequisite", ", ");
+        line(undefined, "undefined prerequisites (" + to_string(undefinedRefs) + " references)", ", ");
+        line(cycles, "prerequisite cycles", "; ");
+        return out;
+    }
+};
+
+// Checks a catalog whose graph is built. The per-course checks run over
+// chunks of CourseIds in parallel, each into its own partial report, and
+// the partials merge in ID order, so the examples are the same for any
+// thread count: the first codes to appear in the file.
+static ValidationReport validateCatalog(const Catalog& catalog, const SkippedRecords& skipped, unsigned threads) {
+    static const size_t kChunk = 16384;
+    const CourseTable& table = catalog.courses;
+    const PrereqGraph& graph = *catalog.graph;
+    ValidationReport report;
+    report.noteSkipped(skipped);
+
+    vector<CourseId> dups = table.replacedIds();
+    sort(dups.begin(), dups.end());
+    dups.erase(unique(dups.begin(), dups.end()), dups.end());
+    for (CourseId id : dups)
+        if (report.duplicates.note()) report.duplicates.examples.emplace_back(table.number(id));
+
+    size_t n = table.idCount();
+    vector<ValidationReport> parts((n + kChunk - 1) / kChunk);
+    parallelFor(parts.size(), threads, [&](size_t c) {
+        ValidationReport& part = parts[c];
+        for (CourseId id = (CourseId)(c * kChunk); id < min(n, (c + 1) * kChunk); ++id) {
+            if (table.isDefined(id)) {
+                Span<CourseId> direct = graph.direct(id); // sorted
+                if (binary_search(direct.begin(), direct.end(), id) && part.selfRefs.note())
+                    part.selfRefs.examples.emplace_back(table.number(id));
+                continue;
+            }
+            Span<CourseId> needers = graph.dependents(id);
+            if (needers.empty()) continue;
+            part.undefinedRefs += needers.size();
+            if (!part.undefined.note()) continue;
+            string ex(table.number(id));
+            ex.append(" (needed by ").append(table.number(needers[0]));
+            if (needers.size() > 1) ex.append(" and ").append(to_string(needers.size() - 1)).append(" more");
+            part.undefined.examples.push_back(ex + ")");
+        }
+    });
+    for (ValidationReport& part : parts) {
+        report.selfRefs.mergeFrom(part.selfRefs);
+        report.undefined.mergeFrom(part.undefined);
+        report.undefinedRefs += part.undefinedRefs;
+    }
+
+    report.cycles.count = graph.cycleCount();
+    for (const vector<CourseId>& cyc : graph.cycles()) {
+        if (report.cycles.examples.size() == ValidationReport::kExamples) break;
+        // a path A, B, ..., A; long ones keep their start and end
+        static const size_t kShown = 6;
+        string ex;
+        for (size_t i = 0; i < cyc.size(); ++i) {
+            if (cyc.size() > kShown + 1 && i == kShown - 1) {
+                ex.append(" -> ...");
+                i = cyc.size() - 2;
+                continue;
+            }
+            ex.append(i ? " -> " : "").append(table.number(cyc[i]));
+        }
+        if (cyc.size() > kShown + 1) ex.append(" (").append(to_string(cyc.size() - 1)).append(" courses)");
+        report.cycles.examples.push_back(ex);
+    }
+    return report;
+}
+
+// -----------------------------------------------------------------------------
+// Option 1: Load File Data
+// -----------------------------------------------------------------------------
+// Builds the prerequisite graph and the search index for an unpublished
+// catalog, and prints the validation report for `source` (its file) to
+// `diag`. The validation and the search index need only the graph, so with
+// threads to spare they run side by side.
+static void buildIndexes(Catalog& catalog, const SkippedRecords& skipped, const string& source,
+                         unsigned threads, ostream& diag = cerr) {
+    const CourseTable& table = catalog.courses;
+    {
+        ABCU_TIME_PHASE(Graph);
+        catalog.graph.reset(new PrereqGraph(table, catalog.listOrder()));
+    }
+    auto buildSearch = [&] {
+        ABCU_TIME_PHASE(Search);
+        catalog.searchIndex.reset(new SearchIndex(table, catalog.sortedKeys.span()));
+    };
+    ValidationReport report;
+    {
+        thread search;
+        if (threads > 1) search = thread(buildSearch);
+        else buildSearch();
+        {
+            ABCU_TIME_PHASE(Validate);
+            report = validateCatalog(catalog, skipped, max(threads - 1, 1u));
+        }
+        if (search.joinable()) search.join();
+    }
+    if (!report.clean()) diag << report.render(source);
+}
+
+// Reads `filename` (CSV, compressed CSV or snapshot) into an unpublished
+// catalog, or reports the error to `diag` and returns null. A CSV load is
+// validated and fully indexed; a snapshot load defers the indexes to first
+// use.
+static shared_ptr<Catalog> readCatalog(const string& filename, const LoadOptions& opt, bool& fromSnapshot,
+                                       ostream& diag = cerr) {
+    auto catalog = make_shared<Catalog>();
+    CourseTable& newTable = catalog->courses;
+    LineParser lp;
+
+    shared_ptr<MappedFile> mapped;
+    {
+        ABCU_TIME_PHASE(Read);
+        mapped = make_shared<MappedFile>(filename);
+    }
+    fromSnapshot = mapped->ok() && isSnapshot(mapped->bytes());
+    if (fromSnapshot) {
+        ABCU_COUNT(bytesRead, mapped->bytes().size());
+        string error;
+        if (!borrowSnapshot(mapped, newTable, catalog->sortedKeys, error)) {
+            diag << "Error: could not load \"" << filename << "\": " << error << ".\n";
+            return nullptr;
+        }
+        applyListOrder(*catalog, opt.order, sortThreads(opt));
+        return catalog;
+    }
+    if (opt.snapshotOnly) {
+        diag << "Error: \"" << filename << "\" is not a course snapshot.\n";
+        return nullptr;
+    }
+
+    try {
+        ABCU_TIME_PHASE(Parse);
+        // big files are read through the pipeline rather than faulted in
+        // from the mapping, so reads overlap parsing on slow storage;
+        // compressed files too, decoding on the pipeline's reader thread
+        bool plainFile = mapped->ok() && compressionOf(mapped->bytes()) == Compression::None;
+        unsigned threads = pickLoadThreads(opt, plainFile ? mapped->bytes().size() : SIZE_MAX);
+        if (plainFile && threads <= 1) {
+            string_view bytes = mapped->bytes();
+            ABCU_COUNT(bytesRead, bytes.size());
+            newTable.reserveBytes(bytes.size());
+            parseCourseBuffer(bytes, 1, lp, newTable);
+        } else {
+            CatalogInput in;
+            if (!in.open(filename, diag)) return nullptr;
+            if (threads > 1) parseCoursePipelined(in.stream(), threads, lp, newTable);
+            else parseCourseStream(in.stream(), lp, newTable);
+        }
+    } catch (const exception& e) {
+        diag << "Error: could not load \"" << filename << "\": " << e.what() << ".\n";
+        return nullptr;
+    }
+    newTable.shrinkToFit();
+#if ABCU_METRICS
+    lp.sampler.publish();
+#endif
+
+    // Store pre-sorted course numbers to avoid re-sorting each time the list is printed
+    vector<CourseId> keys;
+    keys.reserve(newTable.size());
+    for (CourseId id = 0; id < newTable.idCount(); ++id)
+        if (newTable.isDefined(id)) keys.push_back(id);
+    {
+        ABCU_TIME_PHASE(Sort);
+        sortByCode(newTable, keys, sortThreads(opt));
+    }
+    catalog->sortedKeys.adopt(std::move(keys));
+    applyListOrder(*catalog, opt.order, sortThreads(opt));
+    buildIndexes(*catalog, lp.skipped, filename, sortThreads(opt), diag);
+    return catalog;
+}
+
+static bool loadCoursesFromFile(const string& filename, ProgramState& state) {
+    bool fromSnapshot = false;
+    shared_ptr<Catalog> catalog = readCatalog(filename, state.loadOptions, fromSnapshot);
+    if (!catalog) return false;
+
+    // Replace the program state only after the entire file has been parsed
+    // successfully. Readers still holding the previous catalog keep it alive.
+    state.catalog.store(catalog);
+    state.sourceFile = filename;
+    state.sourceStamp = FileStamp::of(filename);
+
+    if (!state.loadOptions.quiet)
+        cout << "Loaded " << catalog->courses.size() << " courses from " << (fromSnapshot ? "snapshot " : "") << "\""
+             << filename << "\".\n";
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Option 6: Reload only the rows that changed
+// -----------------------------------------------------------------------------
+// Re-reads the last CSV file and applies the difference to the loaded table:
+// rows are matched by course ID and compared by hash, so only new, changed
+// and removed rows cost any parsing, and sortedKeys is patched with a merge
+// instead of a full sort. Snapshot-backed catalogs have no row hashes and
+// streams and compressed files cannot be re-read cheaply; all fall back to
+// a full load.
+static bool reloadCoursesIncremental(ProgramState& state) {
+    ABCU_TIME_PHASE(Reload);
+    shared_ptr<const Catalog> current = state.catalog.load();
+    if (!current || state.sourceFile.empty()) {
+        cout << "Please load the data first (Option 1).\n";
+        return false;
+    }
+    const string filename = state.sourceFile;
+    FileStamp stamp = FileStamp::of(filename);
+    if (stamp.valid && stamp == state.sourceStamp) {
+        if (!state.loadOptions.quiet) cout << "No changes in \"" << filename << "\".\n";
+        return true;
+    }
+
+    auto mapped = make_shared<MappedFile>(filename);
+    if (!mapped->ok() || isSnapshot(mapped->bytes()) || compressionOf(mapped->bytes()) != Compression::None ||
+        !current->courses.hasRowHashes())
+        return loadCoursesFromFile(filename, state);
+
+    // patch a copy; readers keep using `current` until the swap
+    auto catalog = make_shared<Catalog>();
+    CourseTable& table = catalog->courses;
+    table.copyFrom(current->courses);
+    LineParser lp;
+    // Latest record for every code: existing IDs in a flat array, new codes
+    // in a map. Later rows overwrite earlier ones, as in a full load.
+    vector<pair<string_view, size_t>> latest(table.idCount());
+    unordered_map<string, pair<string_view, size_t>> fresh;
+    SkippedRecords skipped;
+    forEachRecord(mapped->bytes(), 1, [&](string_view rec, size_t line) {
+        rec = trim(rec);
+        if (rec.empty()) return;
+        if (!splitCSV(rec, lp.fields)) {
+            skipped.unterminated.push_back({line, lastLineOf(line, rec)});
+            return;
+        }
+        if (lp.fields.size() < 2) {
+            skipped.malformed.push_back(line);
+            return;
+        }
+        normalizeCourseId(fieldText(lp.fields[0], lp.scratch), lp.code);
+        if (lp.code.empty()) return;
+        CourseId id = table.find(lp.code);
+        if (id != kNoCourse) latest[id] = {rec, line};
+        else fresh[string(lp.code.view())] = {rec, line};
+    });
+
+    size_t added = 0, updated = 0, removed = 0;
+    vector<CourseId> addedIds;
+    vector<bool> removedIds(table.idCount(), false);
+    try {
+        for (CourseId id = 0; id < latest.size(); ++id) {
+            string_view rec = latest[id].first;
+            bool had = table.isDefined(id);
+            if (rec.empty()) {
+                if (had) {
+                    table.undefine(id);
+                    removedIds[id] = true;
+                    ++removed;
+                }
+            } else if (!had) {
+                parseCourseLine(rec, latest[id].second, lp, table);
+                addedIds.push_back(id);
+                ++added;
+            } else if (table.rowHash(id) != hashRecord(rec)) {
+                parseCourseLine(rec, latest[id].second, lp, table);
+                ++updated;
+            }
+        }
+        // in file order, so warnings and ID assignment are deterministic
+        vector<const pair<const string, pair<string_view, size_t>>*> newRows;
+        for (auto& kv : fresh) newRows.push_back(&kv);
+        sort(newRows.begin(), newRows.end(), [](auto a, auto b) { return a->second.second < b->second.second; });
+        for (auto row : newRows) {
+            parseCourseLine(row->second.first, row->second.second, lp, table);
+            addedIds.push_back(table.find(row->first));
+            ++added;
+        }
+    } catch (const exception& e) {
+        // only the unpublished copy is part-way patched; load in full instead
+        cerr << "Error: incremental reload failed (" << e.what() << "); reloading in full.\n";
+        return loadCoursesFromFile(filename, state);
+    }
+    // only the file's last row for each code was applied
+    table.clearReplaced();
+
+    // Patch the sorted orders: drop removed IDs, sort only the new ones, merge.
+    catalog->sortedKeys.adopt(patchOrder(current->sortedKeys.span(), removedIds, addedIds,
+                                         [&](CourseId id) { return table.number(id); }));
+    applyListOrder(*catalog, state.loadOptions.order, sortThreads(state.loadOptions), current.get(), &removedIds,
+                   &addedIds);
+
+    if (added || updated || removed) {
+        buildIndexes(*catalog, skipped, filename, sortThreads(state.loadOptions));
+        state.catalog.store(catalog);
+    } else if (!skipped.malformed.empty() || !skipped.unterminated.empty()) {
+        ValidationReport report;
+        report.noteSkipped(skipped);
+        cerr << report.render(filename);
+    }
+    state.sourceStamp = stamp;
+
+    if (!state.loadOptions.quiet)
+        cout << "Reloaded \"" << filename << "\": " << added << " added, " << updated << " updated, " << removed
+             << " removed (" << table.size() << " courses).\n";
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// Multi-campus catalogs
+// -----------------------------------------------------------------------------
+// --campus NAME=FILE (repeatable) loads one catalog per campus, the files in
+// parallel. Campuses share most of their courses, so once every file is
+// parsed the codes and titles move into one arena that holds each distinct
+// string once, and every campus table borrows it. Rows, orders and indexes
+// stay per campus, so a campus answers exactly as a load of its file alone.
+struct CampusSource {
+    string name;
+    string file;
+};
+
+// Moves the codes and titles of `catalogs` into one shared arena. Returns
+// the string bytes before and after.
+static pair<size_t, size_t> shareCourseStrings(const vector<shared_ptr<Catalog>>& catalogs) {
+    auto store = make_shared<StringArena>();
+    // keys view the tables' own strings, which stay put until the last step
+    unordered_map<string_view, StrRef> seen;
+    auto intern = [&](string_view s) {
+        auto it = seen.find(s);
+        if (it != seen.end()) return it->second;
+        StrRef r = store->append(s);
+        seen.emplace(s, r);
+        return r;
+    };
+    size_t before = 0;
+    vector<vector<pair<StrRef, StrRef>>> refs(catalogs.size());
+    for (size_t i = 0; i < catalogs.size(); ++i) {
+        const CourseTable& table = catalogs[i]->courses;
+        before += table.stringBytes().size();
+        refs[i].resize(table.idCount());
+        for (CourseId id = 0; id < table.idCount(); ++id)
+            refs[i][id] = {intern(table.number(id)), table.isDefined(id) ? intern(table.title(id)) : StrRef()};
+    }
+    store->shrinkToFit();
+    size_t after = store->storage().size();
+    for (size_t i = 0; i < catalogs.size(); ++i) catalogs[i]->courses.shareStrings(store, refs[i]);
+    return {before, after};
+}
+
+// Makes campus `i` the one the menu, batch modes and requests without
+// ?campus= use.
+static void selectCampus(ProgramState& state, size_t i) {
+    const Campus& c = *state.campuses[i];
+    state.activeCampus = i;
+    state.catalog.store(c.catalog.load());
+    state.sourceFile = c.sourceFile;
+    state.sourceStamp = c.sourceStamp;
+}
+
+// Replaces the program state only if every file loads; the first campus
+// becomes active.
+static bool loadCampuses(const vector<CampusSource>& sources, ProgramState& state) {
+    size_t n = sources.size();
+    unsigned total = sortThreads(state.loadOptions);
+    unsigned workers = (unsigned)min<size_t>(total, n);
+    // split the thread budget between the files loading side by side
+    LoadOptions perFile = state.loadOptions;
+    perFile.threadCap = max(1u, total / workers);
+    if (perFile.threads) perFile.threads = perFile.threadCap;
+
+    // diagnostics per file, printed in order once all are done: cerr is
+    // not safe to share between threads (and would interleave anyway)
+    vector<shared_ptr<Catalog>> catalogs(n);
+    vector<ostringstream> diags(n);
+    parallelFor(n, workers, [&](size_t i) {
+        bool fromSnapshot = false;
+        catalogs[i] = readCatalog(sources[i].file, perFile, fromSnapshot, diags[i]);
+    });
+    for (const ostringstream& d : diags) cerr << d.str();
+    for (size_t i = 0; i < n; ++i)
+        if (!catalogs[i]) return false;
+    pair<size_t, size_t> bytes = shareCourseStrings(catalogs);
+
+    vector<unique_ptr<Campus>> campuses;
+    for (size_t i = 0; i < n; ++i) {
+        campuses.emplace_back(new Campus);
+        Campus& c = *campuses.back();
+        c.name = sources[i].name;
+        c.catalog.store(catalogs[i]);
+        c.sourceFile = sources[i].file;
+        c.sourceStamp = FileStamp::of(sources[i].file);
+    }
+    state.campuses = std::move(campuses);
+    selectCampus(state, 0);
+
+    if (!state.loadOptions.quiet) {
+        for (size_t i = 0; i < n; ++i)
+            cout << "Loaded " << catalogs[i]->courses.size() << " courses for campus " << sources[i].name << " from \""
+                 << sources[i].file << "\".\n";
+        cout << "Course strings: " << bytes.second << " bytes shared (" << bytes.first << " before deduplication).\n";
+    }
+    return true;
+}
+
+// Option 6 (and SIGHUP) with campuses: reloads changed rows of every
+// campus file. A reload that adds strings gives that campus a private
+// copy of the store until the next --campus load.
+static bool reloadCampuses(ProgramState& state) {
+    bool ok = true;
+    for (auto& c : state.campuses) {
+        ProgramState s;
+        s.loadOptions = state.loadOptions;
+        s.catalog.store(c->catalog.load());
+        s.sourceFile = c->sourceFile;
+        s.sourceStamp = c->sourceStamp;
+        if (!reloadCoursesIncremental(s)) ok = false;
+        c->catalog.store(s.catalog.load());
+        c->sourceStamp = s.sourceStamp;
+    }
+    selectCampus(state, state.activeCampus);
+    return ok;
+}
+
+static bool reloadChanged(ProgramState& state) {
+    return state.campuses.empty() ? reloadCoursesIncremental(state) : reloadCampuses(state);
+}
+
+// Option 11: lists the campuses and makes the chosen one active.
+static void switchCampus(ProgramState& state) {
+    if (state.campuses.empty()) {
+        cout << "No campuses loaded (start with --campus NAME=FILE).\n";
+        return;
+    }
+    for (size_t i = 0; i < state.campuses.size(); ++i) {
+        const Campus& c = *state.campuses[i];
+        shared_ptr<const Catalog> catalog = c.catalog.load();
+        cout << (i == state.activeCampus ? "* " : "  ") << c.name << " (" << catalog->courses.size()
+             << " courses, \"" << c.sourceFile << "\")\n";
+    }
+    cout << "Enter the campus name: ";
+    string line;
+    getline(cin, line);
+    string_view name = trim(line);
+    for (size_t i = 0; i < state.campuses.size(); ++i) {
+        if (state.campuses[i]->name != name) continue;
+        selectCampus(state, i);
+        cout << "Using campus " << name << ".\n";
+        return;
+    }
+    cout << "Unknown campus \"" << name << "\".\n";
+}
+
+// -----------------------------------------------------------------------------
+// Option 2: Print full course list (alphanumeric)
+// -----------------------------------------------------------------------------
+enum class ListFormat { Text, Tsv, Json };
+
+// The three list formats, one record at a time; shared with the streaming
+// list (--stream), which has no Catalog.
+static void appendListHeader(string& buf, ListFormat format) {
+    if (format == ListFormat::Tsv) buf.append("id\ttitle\n");
+    else if (format == ListFormat::Json) buf.push_back('[');
+}
+
+static void appendListRow(string& buf, ListFormat format, bool first, string_view number, string_view title) {
+    switch (format) {
+        case ListFormat::Text:
+            buf.append(number).append(", ").append(title).push_back('\n');
+            break;
+        case ListFormat::Tsv:
+            appendTsvField(buf, number);
+            buf.push_back('\t');
+            appendTsvField(buf, title);
+            buf.push_back('\n');
+            break;
+        case ListFormat::Json:
+            buf.append(first ? "\n{\"id\":" : ",\n{\"id\":");
+            appendJsonString(buf, number);
+            buf.append(",\"title\":");
+            appendJsonString(buf, title);
+            buf.push_back('}');
+            break;
+    }
+}
+
+static void appendListFooter(string& buf, ListFormat format) {
+    if (format == ListFormat::Json) buf.append("\n]\n");
+}
+
+// Reads the columnar view, whose rows are already in list order, so the
+// codes and titles come out of two sequential blobs. `flush` runs between
+// records.
+template <typename Flush>
+static void appendCourseList(const Catalog& catalog, ListFormat format, string& buf, Flush flush) {
+    const CourseColumns& cols = catalog.columns();
+    appendListHeader(buf, format);
+    for (uint32_t r = 0; r < cols.size(); ++r) {
+        appendListRow(buf, format, r == 0, cols.code(r), cols.title(r));
+        flush();
+    }
+    appendListFooter(buf, format);
+}
+
+static void printCourseList(const Catalog& catalog, ListFormat format = ListFormat::Text) {
+    OutputBuffer out(cout);
+    appendCourseList(catalog, format, out.str(), [&] { out.maybeFlush(); });
+}
+
+// -----------------------------------------------------------------------------
+// Option 3: Print single course + prerequisites
+// -----------------------------------------------------------------------------
+// Appends the course line and its prerequisite line to `out`.
+static void renderCourse(const CourseTable& table, CourseId id, string& out) {
+    out.append(table.number(id)).append(", ").append(table.title(id)).append("\n");
+
+    Span<CourseId> prereqs = table.prereqs(id);
+    if (prereqs.empty()) {
+        out.append("Prerequisites: None\n");
+        return;
+    }
+
+    out.append("Prerequisites: ");
+    for (size_t i = 0; i < prereqs.size(); ++i) {
+        CourseId pid = prereqs[i];
+        out.append(table.number(pid));
+        if (table.isDefined(pid)) out.append(" (").append(table.title(pid)).append(")");
+        else out.append(" (missing)");
+        if (i + 1 < prereqs.size()) out.append(", ");
+    }
+    out.append("\n");
+}
+
+// Appends render(out) for `id`, or a copy of it from `cache`.
+template <typename Render>
+static void renderCached(RenderCache& cache, CourseId id, string& out, Render render) {
+    if (cache.appendTo(id, out)) {
+        ABCU_COUNT(renderHits, 1);
+        return;
+    }
+    ABCU_COUNT(renderMisses, 1);
+    size_t start = out.size();
+    render(out);
+    cache.insert(id, string_view(out).substr(start));
+}
+
+// Asks for a course ID and resolves it, printing why when it cannot.
+// Returns kNoCourse on failure.
+static CourseId promptForCourse(const Catalog& catalog) {
+    cout << "What course do you want to know about? ";
+    string line;
+    getline(cin, line);
+    CourseCode query = normalizeCourseId(line);
+
+    if (query.empty()) {
+        cout << "No course entered.\n";
+        return kNoCourse;
+    }
+
+    CourseId id = catalog.courses.find(query);
+    if (!catalog.courses.isDefined(id)) {
+        cout << "Course not found.\n";
+        vector<SearchIndex::Hit> hits;
+        catalog.search().search(line, 3, hits);
+        if (!hits.empty()) {
+            string out = "Did you mean: ";
+            for (size_t i = 0; i < hits.size(); ++i) {
+                if (i) out.append(", ");
+                out.append(catalog.courses.number(hits[i].id)).append(" (").append(catalog.courses.title(hits[i].id)).append(")");
+            }
+            cout << out << "?\n";
+        }
+        return kNoCourse;
+    }
+    return id;
+}
+
+static void printSingleCourse(const Catalog& catalog) {
+    CourseId id = promptForCourse(catalog);
+    if (id == kNoCourse) return;
+
+    string out;
+    {
+        ABCU_TIME_LATENCY(courseLookup);
+        renderCached(catalog.courseText, id, out, [&](string& o) { renderCourse(catalog.courses, id, o); });
+    }
+    cout << out;
+}
+
+// -----------------------------------------------------------------------------
+// Option 4: Print every prerequisite, grouped by depth
+// -----------------------------------------------------------------------------
+static void renderAllPrerequisites(const Catalog& catalog, CourseId id, string& out) {
+    const CourseTable& table = catalog.courses;
+    Span<PrereqGraph::Entry> all = catalog.prereqGraph().closure(id);
+    out.append(table.number(id)).append(", ").append(table.title(id)).append("\n");
+    if (all.empty()) {
+        out.append("Prerequisites: None\n");
+        return;
+    }
+
+    out.append("All prerequisites (").append(to_string(all.size())).append("):");
+    for (size_t i = 0; i < all.size(); ++i) {
+        CourseId pid = all[i].id;
+        bool newDepth = i == 0 || all[i - 1].depth != all[i].depth;
+        out.append(newDepth ? "\n  Depth " + to_string(all[i].depth) + ": " : ", ");
+        out.append(table.number(pid));
+        if (table.isDefined(pid)) out.append(" (").append(table.title(pid)).append(")");
+        else out.append(" (missing)");
+    }
+    out.append("\n");
+}
+
+static void printAllPrerequisites(const Catalog& catalog) {
+    CourseId id = promptForCourse(catalog);
+    if (id == kNoCourse) return;
+
+    string out;
+    {
+        ABCU_TIME_LATENCY(prereqLookup);
+        renderAllPrerequisites(catalog, id, out);
+    }
+    cout << out;
+}
+
+// -----------------------------------------------------------------------------
+// Option 5: Check whether a student can take a course
+// -----------------------------------------------------------------------------
+static void checkEligibility(const Catalog& catalog) {
+    CourseId id = promptForCourse(catalog);
+    if (id == kNoCourse) return;
+
+    const CourseTable& table = catalog.courses;
+    cout << "Completed courses (comma separated): ";
+    string line;
+    getline(cin, line);
+
+    CourseSet done(table.idCount());
+    for (size_t pos = 0; pos <= line.size();) {
+        size_t comma = min(line.find(',', pos), line.size());
+        CourseCode code = normalizeCourseId(string_view(line).substr(pos, comma - pos));
+        pos = comma + 1;
+        if (code.empty()) continue;
+        CourseId c = table.find(code);
+        if (table.isDefined(c)) done.add(c);
+        else cout << "Ignoring unknown course " << code.view() << ".\n";
+    }
+
+    const ReachabilityIndex& reach = catalog.prereqGraph().reachability();
+    if (reach.eligible(id, done)) {
+        cout << "Eligible: all prerequisites of " << table.number(id) << " are complete.\n";
+        return;
+    }
+
+    vector<CourseId> missing;
+    reach.missing(id, done, missing);
+    sort(missing.begin(), missing.end(), [&](CourseId a, CourseId b) { return table.number(a) < table.number(b); });
+    string out = "Not eligible. Still needed: ";
+    for (size_t i = 0; i < missing.size(); ++i) {
+        if (i) out.append(", ");
+        out.append(table.number(missing[i]));
+        if (!table.isDefined(missing[i])) out.append(" (missing)");
+    }
+    cout << out << '\n';
+}
+
+// -----------------------------------------------------------------------------
+// Option 7: Search by code prefix or title
+// -----------------------------------------------------------------------------
+static const size_t kSearchResults = 10;
+
+static void searchCourses(const Catalog& catalog) {
+    cout << "Search for (code prefix or title words): ";
+    string line;
+    getline(cin, line);
+    if (trim(line).empty()) {
+        cout << "Nothing entered.\n";
+        return;
+    }
+
+    vector<SearchIndex::Hit> hits;
+    {
+        ABCU_TIME_LATENCY(search);
+        catalog.search().search(line, kSearchResults, hits);
+    }
+    if (hits.empty()) {
+        cout << "No matches.\n";
+        return;
+    }
+    string out;
+    for (const SearchIndex::Hit& h : hits)
+        out.append(catalog.courses.number(h.id)).append(", ").append(catalog.courses.title(h.id)).push_back('\n');
+    cout << out;
+}
+
+// -----------------------------------------------------------------------------
+// Option 8: Plan terms toward target courses
+// -----------------------------------------------------------------------------
+// Lays out a term-by-term schedule for a set of target courses: every
+// prerequisite not yet completed is taken in a term after all of its own
+// prerequisites, with at most `cap` courses per term. Terms are filled
+// Kahn-style from the courses whose prerequisites are done, longest
+// remaining prerequisite chain (critical path) first, then in list order.
+// Plans read the shared graph; all per-student state lives in a per-thread
+// workspace sized once, so a plan costs time proportional to the courses it
+// touches, not to the catalog.
+static const size_t kDefaultTermCap = 4;
+
+struct DegreePlan {
+    vector<CourseId> courses;  // term by term
+    vector<size_t> termStart;  // into courses, plus a final courses.size()
+    vector<CourseId> blocked;  // on or behind a prerequisite cycle
+    vector<CourseId> missing;  // prerequisites not in the catalog (ignored)
+
+    size_t termCount() const { return termStart.empty() ? 0 : termStart.size() - 1; }
+};
+
+class DegreePlanner {
+public:
+    DegreePlanner(const CourseTable& table, const PrereqGraph& graph) : table_(table), graph_(graph) {}
+
+    // `targets` and `completed` hold defined courses.
+    void plan(const vector<CourseId>& targets, const vector<CourseId>& completed, size_t cap, DegreePlan& out) const {
+        Workspace& ws = workspace();
+        out = DegreePlan();
+        cap = max<size_t>(cap, 1);
+
+        // needed courses: targets and their prerequisites, stopping at completed ones
+        for (CourseId c : completed) mark(ws, c, kDone);
+        for (CourseId t : targets)
+            if (ws.local[t] == kUnseen) addNode(ws, t);
+        for (size_t i = 0; i < ws.nodes.size(); ++i) {
+            for (CourseId p : graph_.direct(ws.nodes[i])) {
+                if (ws.local[p] != kUnseen) continue;
+                if (table_.isDefined(p)) {
+                    addNode(ws, p);
+                } else {
+                    mark(ws, p, kMissing);
+                    out.missing.push_back(p);
+                }
+            }
+        }
+
+        // dependents of each needed course, as CSR over local indices
+        size_t n = ws.nodes.size();
+        ws.indegree.assign(n, 0);
+        ws.depStart.assign(n + 1, 0);
+        forEachNeededEdge(ws, [&](uint32_t pre, uint32_t) { ++ws.depStart[pre + 1]; });
+        for (size_t i = 0; i < n; ++i) ws.depStart[i + 1] += ws.depStart[i];
+        ws.deps.resize(ws.depStart[n]);
+        ws.fill.assign(ws.depStart.begin(), ws.depStart.end() - 1);
+        forEachNeededEdge(ws, [&](uint32_t pre, uint32_t course) {
+            ws.deps[ws.fill[pre]++] = course;
+            ++ws.indegree[course];
+        });
+
+        // topological order, then critical path lengths from the far end
+        ws.order.clear();
+        ws.remaining = ws.indegree;
+        for (uint32_t i = 0; i < n; ++i)
+            if (ws.remaining[i] == 0) ws.order.push_back(i);
+        for (size_t k = 0; k < ws.order.size(); ++k)
+            for (uint32_t d : dependents(ws, ws.order[k]))
+                if (--ws.remaining[d] == 0) ws.order.push_back(d);
+        ws.height.assign(n, 1);
+        for (size_t k = ws.order.size(); k-- > 0;) {
+            uint32_t u = ws.order[k];
+            for (uint32_t d : dependents(ws, u)) ws.height[u] = max(ws.height[u], ws.height[d] + 1);
+        }
+
+        // terms: prerequisites must be done in an earlier term, so courses
+        // freed during a term wait for the next one
+        auto later = [&](uint32_t a, uint32_t b) {
+            if (ws.height[a] != ws.height[b]) return ws.height[a] < ws.height[b];
+            return graph_.rank(ws.nodes[a]) > graph_.rank(ws.nodes[b]);
+        };
+        ws.ready.clear();
+        for (uint32_t i = 0; i < n; ++i)
+            if (ws.indegree[i] == 0) ws.ready.push_back(i);
+        make_heap(ws.ready.begin(), ws.ready.end(), later);
+        ws.remaining = ws.indegree;
+        while (!ws.ready.empty()) {
+            out.termStart.push_back(out.courses.size());
+            ws.freed.clear();
+            for (size_t k = 0; k < cap && !ws.ready.empty(); ++k) {
+                pop_heap(ws.ready.begin(), ws.ready.end(), later);
+                uint32_t u = ws.ready.back();
+                ws.ready.pop_back();
+                out.courses.push_back(ws.nodes[u]);
+                for (uint32_t d : dependents(ws, u))
+                    if (--ws.remaining[d] == 0) ws.freed.push_back(d);
+            }
+            for (uint32_t d : ws.freed) {
+                ws.ready.push_back(d);
+                push_heap(ws.ready.begin(), ws.ready.end(), later);
+            }
+        }
+        if (!out.courses.empty()) out.termStart.push_back(out.courses.size());
+        if (ws.order.size() < n) {
+            for (uint32_t i = 0; i < n; ++i)
+                if (ws.remaining[i] != 0) out.blocked.push_back(ws.nodes[i]);
+            sortByRank(out.blocked);
+        }
+        sortByRank(out.missing);
+
+        // leave the workspace clean for the next plan
+        for (CourseId id : ws.touched) ws.local[id] = kUnseen;
+        ws.touched.clear();
+        ws.nodes.clear();
+    }
+
+private:
+    static constexpr uint32_t kUnseen = UINT32_MAX, kDone = UINT32_MAX - 1, kMissing = UINT32_MAX - 2;
+
+    struct Workspace {
+        vector<uint32_t> local;    // CourseId -> index into nodes, or a k* mark
+        vector<CourseId> touched;  // entries of `local` to reset
+        vector<CourseId> nodes;
+        vector<uint32_t> depStart, deps, fill, indegree, remaining, order, height, ready, freed;
+    };
+
+    Workspace& workspace() const {
+        static thread_local Workspace ws;
+        if (ws.local.size() != table_.idCount()) ws.local.assign(table_.idCount(), kUnseen);
+        return ws;
+    }
+    static void mark(Workspace& ws, CourseId id, uint32_t value) {
+        if (ws.local[id] == kUnseen) ws.touched.push_back(id);
+        ws.local[id] = value;
+    }
+    static void addNode(Workspace& ws, CourseId id) {
+        mark(ws, id, (uint32_t)ws.nodes.size());
+        ws.nodes.push_back(id);
+    }
+    // fn(prerequisite, course) for each edge between two needed courses
+    template <typename Fn>
+    void forEachNeededEdge(const Workspace& ws, Fn fn) const {
+        for (uint32_t i = 0; i < ws.nodes.size(); ++i)
+            for (CourseId p : graph_.direct(ws.nodes[i]))
+                if (ws.local[p] < kMissing) fn(ws.local[p], i);
+    }
+    static Span<uint32_t> dependents(const Workspace& ws, uint32_t u) {
+        return {ws.deps.data() + ws.depStart[u], ws.depStart[u + 1] - ws.depStart[u]};
+    }
+    void sortByRank(vector<CourseId>& ids) const {
+        sort(ids.begin(), ids.end(), [&](CourseId a, CourseId b) { return graph_.rank(a) < graph_.rank(b); });
+    }
+
+    const CourseTable& table_;
+    const PrereqGraph& graph_;
+};
+
+// Appends the menu rendering of `plan`.
+static void renderPlan(const CourseTable& table, const DegreePlan& plan, string& out) {
+    if (plan.termCount() == 0 && plan.blocked.empty()) out.append("Nothing left to take.\n");
+    for (size_t t = 0; t < plan.termCount(); ++t) {
+        out.append("Term ").append(to_string(t + 1)).append(": ");
+        for (size_t i = plan.termStart[t]; i < plan.termStart[t + 1]; ++i) {
+            if (i > plan.termStart[t]) out.append(", ");
+            out.append(table.number(plan.courses[i])).append(" (").append(table.title(plan.courses[i])).append(")");
+        }
+        out.push_back('\n');
+    }
+    auto list = [&](const char* label, const vector<CourseId>& ids) {
+        if (ids.empty()) return;
+        out.append(label);
+        for (size_t i = 0; i < ids.size(); ++i) out.append(i ? ", " : "").append(table.number(ids[i]));
+        out.push_back('\n');
+    };
+    list("Cannot schedule (prerequisite cycle): ", plan.blocked);
+    list("Not in the catalog (ignored): ", plan.missing);
+}
+
+// Resolves a list of codes separated by `sep`; unknown codes go to `unknown`.
+static void parseCourseList(const CourseTable& table, string_view text, char sep, vector<CourseId>& ids,
+                            vector<string>* unknown) {
+    ids.clear();
+    for (size_t pos = 0; pos <= text.size();) {
+        size_t end = min(text.find(sep, pos), text.size());
+        CourseCode code = normalizeCourseId(text.substr(pos, end - pos));
+        pos = end + 1;
+        if (code.empty()) continue;
+        CourseId id = table.find(code);
+        if (table.isDefined(id)) ids.push_back(id);
+        else if (unknown) unknown->emplace_back(code.view());
+    }
+}
+
+static void planTerms(const Catalog& catalog, size_t cap) {
+    const CourseTable& table = catalog.courses;
+    cout << "Target courses (comma separated): ";
+    string line;
+    getline(cin, line);
+    vector<CourseId> targets, completed;
+    vector<string> unknown;
+    parseCourseList(table, line, ',', targets, &unknown);
+    cout << "Completed courses (comma separated): ";
+    getline(cin, line);
+    parseCourseList(table, line, ',', completed, &unknown);
+    for (const string& code : unknown) cout << "Ignoring unknown course " << code << ".\n";
+    if (targets.empty()) {
+        cout << "No target courses entered.\n";
+        return;
+    }
+
+    DegreePlan plan;
+    DegreePlanner(table, catalog.prereqGraph()).plan(targets, completed, cap, plan);
+    string out;
+    renderPlan(table, plan, out);
+    cout << out;
+}
+
+// Plans every student in `in` (CSV rows "student,targets,completed" with
+// ';' between courses) on `threads` workers and writes one TSV row per
+// term: student, term number, space-separated courses. Problems get rows
+// with "unknown", "blocked" or "missing" in place of the term.
+static void runPlanBatch(const Catalog& catalog, istream& in, size_t cap, unsigned threads, ostream& os) {
+    static const size_t kBlock = 4096; // students rendered per parallel round
+    const CourseTable& table = catalog.courses;
+    DegreePlanner planner(table, catalog.prereqGraph());
+    WorkStealingPool pool(threads);
+    OutputBuffer out(os);
+    out << "student\tterm\tcourses\n";
+
+    vector<string> lines, rendered(kBlock);
+    auto flushBlock = [&] {
+        pool.parallelFor(lines.size(), [&](size_t i) {
+            static thread_local vector<CsvField> fields;
+            static thread_local string scratch;
+            static thread_local vector<CourseId> targets, completed;
+            static thread_local vector<string> unknown;
+            static thread_local DegreePlan plan;
+            string& r = rendered[i];
+            r.clear();
+            splitCSV(lines[i], fields);
+            string student(fieldText(fields[0], scratch));
+            unknown.clear();
+            parseCourseList(table, fields.size() > 1 ? fieldText(fields[1], scratch) : "", ';', targets, &unknown);
+            parseCourseList(table, fields.size() > 2 ? fieldText(fields[2], scratch) : "", ';', completed, &unknown);
+            planner.plan(targets, completed, cap, plan);
+
+            auto row = [&](string_view term, const CourseId* ids, size_t count) {
+                r.append(student).append("\t").append(term).append("\t");
+                for (size_t k = 0; k < count; ++k) r.append(k ? " " : "").append(table.number(ids[k]));
+                r.push_back('\n');
+            };
+            if (!unknown.empty()) {
+                r.append(student).append("\tunknown\t");
+                for (size_t k = 0; k < unknown.size(); ++k) r.append(k ? " " : "").append(unknown[k]);
+                r.push_back('\n');
+            }
+            for (size_t t = 0; t < plan.termCount(); ++t)
+                row(to_string(t + 1), plan.courses.data() + plan.termStart[t], plan.termStart[t + 1] - plan.termStart[t]);
+            if (!plan.blocked.empty()) row("blocked", plan.blocked.data(), plan.blocked.size());
+            if (!plan.missing.empty()) row("missing", plan.missing.data(), plan.missing.size());
+        });
+        for (size_t i = 0; i < lines.size(); ++i) {
+            out << rendered[i];
+            out.maybeFlush();
+        }
+        lines.clear();
+    };
+
+    string line;
+    while (getline(in, line)) {
+        if (trim(line).empty()) continue;
+        lines.push_back(line);
+        if (lines.size() == kBlock) flushBlock();
+    }
+    if (!lines.empty()) flushBlock();
+}
+
+// -----------------------------------------------------------------------------
+// Option 10: Print the courses that depend on a course
+// -----------------------------------------------------------------------------
+// The impact of dropping a course: depth 1 lists the courses naming it as a
+// prerequisite, deeper levels the courses that need those in turn.
+static void renderDependents(const Catalog& catalog, CourseId id, string& out) {
+    const CourseTable& table = catalog.courses;
+    vector<PrereqGraph::Entry> all;
+    catalog.prereqGraph().dependentClosure(id, all);
+    out.append(table.number(id)).append(", ").append(table.title(id)).append("\n");
+    if (all.empty()) {
+        out.append("Needed by: None\n");
+        return;
+    }
+
+    out.append("Needed by (").append(to_string(all.size())).append("):");
+    for (size_t i = 0; i < all.size(); ++i) {
+        bool newDepth = i == 0 || all[i - 1].depth != all[i].depth;
+        out.append(newDepth ? "\n  Depth " + to_string(all[i].depth) + ": " : ", ");
+        out.append(table.number(all[i].id)).append(" (").append(table.title(all[i].id)).append(")");
+    }
+    out.append("\n");
+}
+
+static void printDependents(const Catalog& catalog) {
+    CourseId id = promptForCourse(catalog);
+    if (id == kNoCourse) return;
+
+    string out;
+    {
+        ABCU_TIME_LATENCY(dependentsLookup);
+        renderDependents(catalog, id, out);
+    }
+    cout << out;
+}
+
+// -----------------------------------------------------------------------------
+// Scan queries (--scan, /scan)
+// -----------------------------------------------------------------------------
+// Filters and aggregates over the whole catalog, run on the columnar view:
+//   roots           courses with no prerequisites
+//   leaves          courses no other course needs
+//   missing         courses with an undefined prerequisite
+//   min-prereqs:N   courses with at least N prerequisites
+//   fanout, fanin   how many courses have each number of prerequisites
+//                   (fanout) or of courses needing them (fanin)
+//   summary         totals of the above
+// Filters print like the course list, in list order.
+enum class ScanKind { Roots, Leaves, Missing, MinPrereqs, Fanout, Fanin, Summary };
+
+struct ScanQuery {
+    ScanKind kind = ScanKind::Summary;
+    uint32_t n = 0; // min-prereqs threshold
+};
+
+static bool parseScanQuery(string_view text, ScanQuery& q) {
+    static const pair<const char*, ScanKind> kNames[] = {
+        {"roots", ScanKind::Roots},   {"leaves", ScanKind::Leaves}, {"missing", ScanKind::Missing},
+        {"fanout", ScanKind::Fanout}, {"fanin", ScanKind::Fanin},   {"summary", ScanKind::Summary}};
+    for (const auto& kn : kNames) {
+        if (text != kn.first) continue;
+        q.kind = kn.second;
+        return true;
+    }
+    string_view prefix = "min-prereqs:";
+    if (text.substr(0, prefix.size()) != prefix || text.size() == prefix.size()) return false;
+    uint32_t n = 0;
+    for (char c : text.substr(prefix.size())) {
+        if (c < '0' || c > '9' || n > (UINT32_MAX - 9) / 10) return false;
+        n = n * 10 + (uint32_t)(c - '0');
+    }
+    q.kind = ScanKind::MinPrereqs;
+    q.n = n;
+    return true;
+}
+
+// Row numbers where keep(row) holds. The store is unconditional and only
+// the cursor depends on the test, so the loop has no branch to mispredict.
+template <typename Keep>
+static void selectRows(size_t n, vector<uint32_t>& out, Keep keep) {
+    out.resize(n);
+    size_t k = 0;
+    for (uint32_t r = 0; r < n; ++r) {
+        out[k] = r;
+        k += keep(r) ? 1 : 0;
+    }
+    out.resize(k);
+}
+
+template <typename Test>
+static size_t countIf(Span<uint32_t> col, Test test) {
+    size_t k = 0;
+    for (size_t r = 0; r < col.size(); ++r) k += test(col[r]) ? 1 : 0;
+    return k;
+}
+
+static uint32_t columnMax(Span<uint32_t> col) {
+    uint32_t m = 0;
+    for (size_t r = 0; r < col.size(); ++r) m = max(m, col[r]);
+    return m;
+}
+
+// "value: courses" rows for every value from 0 to the column's maximum
+// that occurs.
+static void appendHistogram(string& out, ListFormat format, const char* label, Span<uint32_t> col) {
+    vector<size_t> counts((size_t)columnMax(col) + 1, 0);
+    for (size_t r = 0; r < col.size(); ++r) ++counts[col[r]];
+    if (format == ListFormat::Tsv) out.append(label).append("\tcourses\n");
+    else if (format == ListFormat::Json) out.push_back('[');
+    bool first = true;
+    for (size_t v = 0; v < counts.size(); ++v) {
+        if (!counts[v]) continue;
+        if (format == ListFormat::Json) {
+            out.append(first ? "\n{\"" : ",\n{\"").append(label).append("\":").append(to_string(v));
+            out.append(",\"courses\":").append(to_string(counts[v])).push_back('}');
+        } else if (format == ListFormat::Tsv) {
+            out.append(to_string(v)).push_back('\t');
+            out.append(to_string(counts[v])).push_back('\n');
+        } else {
+            out.append(to_string(v)).append(" ").append(label).append(": ").append(to_string(counts[v]));
+            out.append(counts[v] == 1 ? " course\n" : " courses\n");
+        }
+        first = false;
+    }
+    if (format == ListFormat::Json) out.append("\n]\n");
+}
+
+static void appendScan(const Catalog& catalog, const ScanQuery& q, ListFormat format, string& out) {
+    const CourseColumns& cols = catalog.columns();
+    Span<uint32_t> prereqs = cols.prereqCounts(), fanIn = cols.fanIn(), missing = cols.missing();
+    auto isZero = [](uint32_t v) { return v == 0; };
+    if (q.kind == ScanKind::Fanout) return appendHistogram(out, format, "prerequisites", prereqs);
+    if (q.kind == ScanKind::Fanin) return appendHistogram(out, format, "dependents", fanIn);
+    if (q.kind == ScanKind::Summary) {
+        const pair<const char*, size_t> totals[] = {
+            {"courses", cols.size()},
+            {"prerequisite_links", cols.linkCount()},
+            {"roots", countIf(prereqs, isZero)},
+            {"leaves", countIf(fanIn, isZero)},
+            {"with_missing_prerequisites", cols.size() - countIf(missing, isZero)},
+            {"max_prerequisites", columnMax(prereqs)},
+            {"max_dependents", columnMax(fanIn)}};
+        if (format == ListFormat::Tsv) out.append("metric\tvalue\n");
+        else if (format == ListFormat::Json) out.push_back('{');
+        for (size_t i = 0; i < size(totals); ++i) {
+            if (format == ListFormat::Json)
+                out.append(i ? ",\"" : "\"").append(totals[i].first).append("\":").append(to_string(totals[i].second));
+            else
+                out.append(totals[i].first).append(format == ListFormat::Tsv ? "\t" : ": ")
+                    .append(to_string(totals[i].second)).push_back('\n');
+        }
+        if (format == ListFormat::Json) out.append("}\n");
+        return;
+    }
+
+    const uint32_t* p = prereqs.ptr;
+    const uint32_t* f = fanIn.ptr;
+    const uint32_t* m = missing.ptr;
+    vector<uint32_t> rows;
+    switch (q.kind) {
+        case ScanKind::Roots: selectRows(cols.size(), rows, [&](uint32_t r) { return p[r] == 0; }); break;
+        case ScanKind::Leaves: selectRows(cols.size(), rows, [&](uint32_t r) { return f[r] == 0; }); break;
+        case ScanKind::Missing: selectRows(cols.size(), rows, [&](uint32_t r) { return m[r] != 0; }); break;
+        default: selectRows(cols.size(), rows, [&](uint32_t r) { return p[r] >= q.n; }); break;
+    }
+    appendListHeader(out, format);
+    for (size_t i = 0; i < rows.size(); ++i) appendListRow(out, format, i == 0, cols.code(rows[i]), cols.title(rows[i]));
+    appendListFooter(out, format);
+}
+
+static void printScan(const Catalog& catalog, const ScanQuery& q, ListFormat format) {
+    OutputBuffer out(cout);
+    appendScan(catalog, q, format, out.str());
+}
+
+// -----------------------------------------------------------------------------
+// Batch queries (--query-file)
+// -----------------------------------------------------------------------------
+// Looks up every course ID in `in` (one per line) and writes the Option 3
+// output for each. Lookups run first, over the whole batch; output goes
+// through one OutputBuffer.
+static void runBatchQueries(const Catalog& catalog, istream& in, bool sortBatch, ostream& os) {
+    vector<CourseCode> queries;
+    string line;
+    while (getline(in, line)) {
+        CourseCode q = normalizeCourseId(line);
+        if (!q.empty()) queries.push_back(std::move(q));
+    }
+    if (sortBatch) {
+        // sorted order walks the catalog roughly in order and drops repeats
+        sort(queries.begin(), queries.end());
+        queries.erase(unique(queries.begin(), queries.end()), queries.end());
+    }
+
+    const CourseTable& table = catalog.courses;
+    vector<CourseId> ids(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) ids[i] = table.find(queries[i]);
+
+    OutputBuffer out(os);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        ABCU_TIME_LATENCY(courseLookup);
+        if (table.isDefined(ids[i])) renderCourse(table, ids[i], out.str());
+        else out << queries[i] << ": Course not found.\n";
+        out.maybeFlush();
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Bounded-memory streaming (--stream, --check)
+// -----------------------------------------------------------------------------
+// For catalogs that do not fit in memory. Records are read a chunk at a time
+// and no CourseTable is built; whatever has to be ordered goes through an
+// external merge sort that spills sorted runs to temp files.
+struct StreamOptions {
+    size_t memoryBytes = 256u << 20; // sort buffer; beyond this, runs spill to disk
+    string tempDir;                  // default: the system temp directory
+};
+
+// Sorts (key, payload) byte records by key, keeping insertion order among
+// equal keys. Memory in use stays within opt.memoryBytes plus one read
+// buffer per run while merging. Temp file errors throw runtime_error.
+class ExternalSorter {
+public:
+    static const size_t kMaxFanIn = 64; // runs merged at once; more take extra passes
+
+    explicit ExternalSorter(const StreamOptions& opt)
+        : opt_(opt), arenaLimit_(opt.memoryBytes / 4 * 3), entryLimit_(opt.memoryBytes / 4 / sizeof(Entry)) {}
+    ~ExternalSorter() {
+        for (const string& f : runs_) {
+            error_code ec;
+            filesystem::remove(f, ec);
+        }
+    }
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(string_view key, string_view payload) {
+        size_t n = key.size() + payload.size();
+        if (!entries_.empty() && (arena_.size() + n > arenaLimit_ || entries_.size() == entryLimit_)) spill();
+        // grow by hand so doubling never overshoots the budget
+        if (arena_.size() + n > arena_.capacity())
+            arena_.reserve(max(arena_.size() + n, min(max<size_t>(arena_.capacity() * 2, 1u << 16), arenaLimit_)));
+        if (entries_.size() == entries_.capacity())
+            entries_.reserve(max<size_t>(1, min(max<size_t>(entries_.capacity() * 2, 4096), entryLimit_)));
+        entries_.push_back({arena_.size(), (uint32_t)key.size(), (uint32_t)payload.size()});
+        arena_.insert(arena_.end(), key.begin(), key.end());
+        arena_.insert(arena_.end(), payload.begin(), payload.end());
+    }
+
+    size_t runCount() const { return runs_.size(); }
+
+    // Calls fn(key, payload) for every record, in order. Input that fit in
+    // memory never touches the disk.
+    template <typename Fn>
+    void finish(Fn fn) {
+        if (runs_.empty()) {
+            sortEntries();
+            for (const Entry& e : entries_) fn(keyOf(e), payloadOf(e));
+            return;
+        }
+        if (!entries_.empty()) spill();
+        vector<char>().swap(arena_);
+        vector<Entry>().swap(entries_);
+        while (runs_.size() > kMaxFanIn) {
+            // merge consecutive groups, so earlier records stay first
+            vector<string> merged;
+            for (size_t i = 0; i < runs_.size(); i += kMaxFanIn) {
+                vector<string> group(runs_.begin() + i, runs_.begin() + min(runs_.size(), i + kMaxFanIn));
+                RunWriter out(newRunPath(), ioBufferBytes());
+                merged.push_back(out.path);
+                mergeRuns(group, [&](string_view k, string_view p) { out.write(k, p); });
+                out.close();
+                for (const string& f : group) {
+                    error_code ec;
+                    filesystem::remove(f, ec);
+                }
+            }
+            runs_.swap(merged);
+        }
+        mergeRuns(runs_, fn);
+    }
+
+private:
+    struct Entry {
+        size_t offset;
+        uint32_t keyLen, payloadLen;
+    };
+
+    // Run files are a sequence of [u32 key length][u32 payload length][key][payload].
+    struct RunWriter {
+        string path;
+        vector<char> buf;
+        ofstream out;
+        RunWriter(string p, size_t bufBytes) : path(std::move(p)), buf(bufBytes) {
+            out.rdbuf()->pubsetbuf(buf.data(), (streamsize)buf.size());
+            out.open(path, ios::binary | ios::trunc);
+            if (!out) throw runtime_error("could not create temp file \"" + path + "\"");
+        }
+        void write(string_view key, string_view payload) {
+            uint32_t len[2] = {(uint32_t)key.size(), (uint32_t)payload.size()};
+            out.write((const char*)len, sizeof len);
+            out.write(key.data(), (streamsize)key.size());
+            out.write(payload.data(), (streamsize)payload.size());
+        }
+        void close() {
+            out.close();
+            if (!out) throw runtime_error("could not write temp file \"" + path + "\"");
+        }
+    };
+
+    struct RunReader {
+        vector<char> buf;
+        ifstream in;
+        string key, payload;
+        RunReader(const string& path, size_t bufBytes) : buf(bufBytes) {
+            in.rdbuf()->pubsetbuf(buf.data(), (streamsize)buf.size());
+            in.open(path, ios::binary);
+            if (!in) throw runtime_error("could not reopen temp file \"" + path + "\"");
+        }
+        bool next() {
+            uint32_t len[2];
+            if (!in.read((char*)len, sizeof len)) return false;
+            key.resize(len[0]);
+            payload.resize(len[1]);
+            in.read(&key[0], len[0]);
+            in.read(&payload[0], len[1]);
+            if (!in) throw runtime_error("temp file truncated");
+            return true;
+        }
+    };
+
+    string_view keyOf(const Entry& e) const { return {arena_.data() + e.offset, e.keyLen}; }
+    string_view payloadOf(const Entry& e) const { return {arena_.data() + e.offset + e.keyLen, e.payloadLen}; }
+
+    void sortEntries() {
+        stable_sort(entries_.begin(), entries_.end(),
+                    [&](const Entry& a, const Entry& b) { return keyOf(a) < keyOf(b); });
+    }
+
+    void spill() {
+        sortEntries();
+        RunWriter out(newRunPath(), 1u << 20);
+        runs_.push_back(out.path);
+        for (const Entry& e : entries_) out.write(keyOf(e), payloadOf(e));
+        out.close();
+        arena_.clear();
+        entries_.clear();
+    }
+
+    // Keeps kMaxFanIn readers (plus one writer) inside the memory budget.
+    size_t ioBufferBytes() const {
+        return min<size_t>(1u << 20, max<size_t>(1u << 16, opt_.memoryBytes / (kMaxFanIn + 1)));
+    }
+
+    string newRunPath() {
+        static atomic<uint64_t> counter{0};
+        filesystem::path dir = opt_.tempDir.empty() ? filesystem::temp_directory_path() : filesystem::path(opt_.tempDir);
+        uint64_t tag = (uint64_t)chrono::steady_clock::now().time_since_epoch().count() ^ (uint64_t)(uintptr_t)this;
+        return (dir / ("abcu-sort-" + to_string(tag) + "-" + to_string(counter++) + ".run")).string();
+    }
+
+    template <typename Fn>
+    void mergeRuns(const vector<string>& files, Fn fn) {
+        vector<unique_ptr<RunReader>> readers;
+        for (const string& f : files) readers.emplace_back(new RunReader(f, ioBufferBytes()));
+        // min-heap on (key, run): equal keys come out in run order
+        auto later = [&](size_t a, size_t b) {
+            int c = readers[a]->key.compare(readers[b]->key);
+            return c != 0 ? c > 0 : a > b;
+        };
+        vector<size_t> heap;
+        for (size_t i = 0; i < readers.size(); ++i)
+            if (readers[i]->next()) heap.push_back(i);
+        make_heap(heap.begin(), heap.end(), later);
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), later);
+            size_t r = heap.back();
+            fn(string_view(readers[r]->key), string_view(readers[r]->payload));
+            if (readers[r]->next()) push_heap(heap.begin(), heap.end(), later);
+            else heap.pop_back();
+        }
+    }
+
+    StreamOptions opt_;
+    size_t arenaLimit_, entryLimit_;
+    vector<char> arena_;
+    vector<Entry> entries_;
+    vector<string> runs_;
+};
+
+enum class StreamRecord { Skip, Malformed, Unterminated, Course };
+
+// Parses one record the way parseCourseLine does, without a table: for a
+// Course, lp.code gets its code, `prereqs` its prerequisite codes and
+// `title` its title (which may point into lp.scratch).
+static StreamRecord parseStreamRecord(string_view line, LineParser& lp, vector<CourseCode>& prereqs,
+                                      string_view& title) {
+    line = trim(line);
+    if (line.empty()) return StreamRecord::Skip;
+    if (!splitCSV(line, lp.fields)) return StreamRecord::Unterminated;
+    if (lp.fields.size() < 2) return StreamRecord::Malformed;
+    normalizeCourseId(fieldText(lp.fields[0], lp.scratch), lp.code);
+    if (lp.code.empty()) return StreamRecord::Skip;
+    prereqs.clear();
+    for (size_t i = 2; i < lp.fields.size(); ++i) {
+        CourseCode pre = normalizeCourseId(fieldText(lp.fields[i], lp.scratch));
+        if (!pre.empty()) prereqs.push_back(std::move(pre));
+    }
+    title = fieldText(lp.fields[1], lp.scratch);
+    return StreamRecord::Course;
+}
+
+// Opens `filename` for streaming and reads its first bytes into `head`
+// (for forEachStreamRecord) to turn away snapshots; pipes cannot seek back.
+static bool openStream(const string& filename, CatalogInput& in) {
+    if (!in.open(filename)) return false;
+    if (in.head() == string_view(kSnapshotMagic, sizeof kSnapshotMagic)) {
+        cerr << "Error: \"" << filename << "\" is a snapshot; streaming reads CSV catalogs only.\n";
+        return false;
+    }
+    return true;
+}
+
+// The Option 2 list of `filename` (last row wins, as when loading), sorted
+// externally. Only codes and titles are kept, and only up to the budget.
+// In natural order the sort key is the collation key and the payload is
+// "code\ttitle" (codes never hold a tab).
+static int runStreamList(const string& filename, ListFormat format, CourseOrder order, const StreamOptions& opt) {
+    CatalogInput in;
+    if (!openStream(filename, in)) return 1;
+    try {
+        ExternalSorter sorter(opt);
+        LineParser lp;
+        vector<CourseCode> prereqs;
+        bool natural = order == CourseOrder::Natural;
+        string key, payload;
+        bool ok = forEachStreamRecord(in.stream(), [&](string_view rec, size_t line) {
+            string_view title;
+            StreamRecord kind = parseStreamRecord(rec, lp, prereqs, title);
+            if (kind == StreamRecord::Malformed) cerr << "Warning: malformed line " << line << ".\n";
+            if (kind == StreamRecord::Unterminated)
+                cerr << "Warning: unterminated quote, skipped lines " << line << "-" << lastLineOf(line, rec) << ".\n";
+            if (kind != StreamRecord::Course) return;
+            if (!natural) return sorter.add(lp.code.view(), title);
+            key.clear();
+            appendNaturalKey(lp.code.view(), key);
+            payload.assign(lp.code.view()).append("\t").append(title);
+            sorter.add(key, payload);
+        });
+        if (!ok) throw runtime_error("read error");
+
+        OutputBuffer out(cout);
+        string lastKey, lastCode, lastTitle;
+        bool pending = false, first = true;
+        auto emit = [&] {
+            appendListRow(out.str(), format, first, natural ? lastCode : lastKey, lastTitle);
+            first = false;
+            out.maybeFlush();
+        };
+        appendListHeader(out.str(), format);
+        sorter.finish([&](string_view k, string_view p) {
+            if (pending && k != lastKey) emit();
+            lastKey.assign(k);
+            if (natural) {
+                size_t tab = p.find('\t');
+                lastCode.assign(p.substr(0, tab));
+                p.remove_prefix(tab + 1);
+            }
+            lastTitle.assign(p);
+            pending = true;
+        });
+        if (pending) emit();
+        appendListFooter(out.str(), format);
+    } catch (const exception& e) {
+        cerr << "Error: could not list \"" << filename << "\": " << e.what() << ".\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Checks `filename` in one pass plus an external sort of (code, role)
+// pairs: a code's definitions and references meet in one group, which
+// finds duplicate rows and undefined prerequisites without holding the
+// catalog. Prints the first few of each problem and a summary; returns 1
+// if any were found. Cycles need the whole graph and are left to a load.
+static int runStreamCheck(const string& filename, const StreamOptions& opt) {
+    static const size_t kExamples = 20;
+    CatalogInput in;
+    if (!openStream(filename, in)) return 1;
+
+    size_t records = 0, courses = 0, duplicates = 0, selfRefs = 0, undefined = 0, danglingRefs = 0;
+    size_t malformed = 0;
+    try {
+        ExternalSorter sorter(opt);
+        LineParser lp;
+        vector<CourseCode> prereqs;
+        string payload;
+        bool ok = forEachStreamRecord(in.stream(), [&](string_view rec, size_t line) {
+            string_view title;
+            StreamRecord kind = parseStreamRecord(rec, lp, prereqs, title);
+            records += kind != StreamRecord::Skip || !trim(rec).empty();
+            if (kind == StreamRecord::Malformed && malformed++ < kExamples)
+                cerr << "Warning: malformed line " << line << ".\n";
+            if (kind == StreamRecord::Unterminated && malformed++ < kExamples)
+                cerr << "Warning: unterminated quote, skipped lines " << line << "-" << lastLineOf(line, rec) << ".\n";
+            if (kind != StreamRecord::Course) return;
+            payload.assign("D").append(to_string(line));
+            sorter.add(lp.code.view(), payload);
+            for (const CourseCode& pre : prereqs) {
+                if (pre == lp.code) {
+                    if (selfRefs++ < kExamples)
+                        cerr << "Warning: " << lp.code.view() << " (line " << line
+                             << ") lists itself as a prerequisite.\n";
+                    continue;
+                }
+                payload.assign("R").append(lp.code.view());
+                sorter.add(pre.view(), payload);
+            }
+        });
+        if (!ok) throw runtime_error("read error");
+
+        // one group per code: its "D<line>" definitions and "R<course>" references
+        string key;
+        vector<string> defLines, referrers; // the first few of each
+        size_t defs = 0, refs = 0;
+        auto closeGroup = [&] {
+            if (defs == 0 && refs == 0) return;
+            if (defs) ++courses;
+            if (defs > 1 && duplicates++ < kExamples) {
+                cerr << "Warning: " << key << " is defined " << defs << " times (lines ";
+                for (size_t i = 0; i < defLines.size(); ++i) cerr << (i ? ", " : "") << defLines[i];
+                cerr << (defs > defLines.size() ? ", ...)" : ")") << "; the last row wins.\n";
+            }
+            if (defs == 0) {
+                danglingRefs += refs;
+                if (undefined++ < kExamples) {
+                    cerr << "Warning: " << key << " is a prerequisite of ";
+                    for (size_t i = 0; i < referrers.size(); ++i) cerr << (i ? ", " : "") << referrers[i];
+                    if (refs > referrers.size()) cerr << " and " << refs - referrers.size() << " more";
+                    cerr << " but is never defined.\n";
+                }
+            }
+            defLines.clear();
+            referrers.clear();
+            defs = refs = 0;
+        };
+        sorter.finish([&](string_view k, string_view p) {
+            if (k != key) {
+                closeGroup();
+                key.assign(k);
+            }
+            if (p[0] == 'D') {
+                if (defs++ < 8) defLines.emplace_back(p.substr(1));
+            } else if (refs++ < 3) {
+                referrers.emplace_back(p.substr(1));
+            }
+        });
+        closeGroup();
+    } catch (const exception& e) {
+        cerr << "Error: could not check \"" << filename << "\": " << e.what() << ".\n";
+        return 1;
+    }
+
+    const pair<size_t, const char*> shown[] = {
+        {malformed, "malformed lines"}, {selfRefs, "self-references"}, {duplicates, "duplicated courses"}, {undefined, "undefined prerequisites"}};
+    for (const auto& s : shown)
+        if (s.first > kExamples) cerr << "Warning: " << s.first - kExamples << " more " << s.second << " not shown.\n";
+    cout << "Checked " << records << " records: " << courses << " courses, " << malformed << " malformed lines, "
+         << duplicates << " duplicated courses, " << selfRefs << " self-references, " << undefined
+         << " undefined prerequisites (" << danglingRefs << " references).\n";
+    return malformed || duplicates || selfRefs || undefined ? 1 : 0;
+}
+
+// -----------------------------------------------------------------------------
+// Metrics export (--stats, GET /metrics)
+// -----------------------------------------------------------------------------
+#if ABCU_METRICS
+static void appendFormat(string& out, const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) out.append(buf, min<size_t>((size_t)n, sizeof(buf) - 1));
+}
+
+static const pair<const char*, const LatencyHistogram Metrics::*> kLatencyOps[] = {
+    {"course", &Metrics::courseLookup}, {"prereqs", &Metrics::prereqLookup},
+    {"dependents", &Metrics::dependentsLookup}, {"search", &Metrics::search}};
+
+// Human-readable summary for --stats. `catalog` may be null.
+static void appendStatsText(string& out, const Catalog* catalog) {
+    const Metrics& m = metrics();
+    out += "Phase            ms        calls\n";
+    for (size_t i = 0; i < (size_t)Phase::Count; ++i) {
+        uint64_t calls = m.phaseCalls[i].load(memory_order_relaxed);
+        if (!calls) continue;
+        bool sampled = i == (size_t)Phase::Split || i == (size_t)Phase::Normalize || i == (size_t)Phase::Insert;
+        appendFormat(out, "%-10s %10.3f %12llu%s\n", kPhaseNames[i],
+                     (double)m.phaseNs[i].load(memory_order_relaxed) / 1e6, (unsigned long long)calls,
+                     sampled ? "  (sampled, summed over threads)" : "");
+    }
+    out += "\nLatency (us)     count      p50      p90      p99      max     mean\n";
+    for (const auto& op : kLatencyOps) {
+        const LatencyHistogram& h = m.*op.second;
+        uint64_t n = h.count();
+        if (!n) continue;
+        appendFormat(out, "%-10s %11llu %8.1f %8.1f %8.1f %8.1f %8.1f\n", op.first, (unsigned long long)n,
+                     (double)h.quantile(0.5) / 1e3, (double)h.quantile(0.9) / 1e3, (double)h.quantile(0.99) / 1e3,
+                     (double)h.quantile(1.0) / 1e3, (double)h.sum() / (double)n / 1e3);
+    }
+    if (catalog) {
+        IndexStats s = catalog->courses.indexStats();
+        appendFormat(out, "\nIndex: %zu entries, %zu slots (load %.2f), mean probe %.3f, max probe %zu\n", s.entries,
+                     s.capacity, s.capacity ? (double)s.entries / (double)s.capacity : 0.0, s.meanProbe, s.maxProbe);
+    }
+    appendFormat(out, "\nHeap: %llu allocations (%llu bytes), %llu frees\n",
+                 (unsigned long long)m.allocations.load(memory_order_relaxed),
+                 (unsigned long long)m.allocatedBytes.load(memory_order_relaxed),
+                 (unsigned long long)m.frees.load(memory_order_relaxed));
+    appendFormat(out, "IO: %llu bytes read, %llu bytes written\n",
+                 (unsigned long long)m.bytesRead.load(memory_order_relaxed),
+                 (unsigned long long)m.bytesWritten.load(memory_order_relaxed));
+    appendFormat(out, "Render cache: %llu hits, %llu misses\n",
+                 (unsigned long long)m.renderHits.load(memory_order_relaxed),
+                 (unsigned long long)m.renderMisses.load(memory_order_relaxed));
+}
+
+// Prometheus text exposition format, version 0.0.4. Latency buckets are the
+// histogram's power-of-two boundaries, cumulative as Prometheus expects.
+static void appendPrometheus(string& out, const Catalog* catalog) {
+    const Metrics& m = metrics();
+    out += "# HELP abcu_phase_seconds_total Time spent per load/index phase.\n"
+           "# TYPE abcu_phase_seconds_total counter\n";
+    for (size_t i = 0; i < (size_t)Phase::Count; ++i)
+        appendFormat(out, "abcu_phase_seconds_total{phase=\"%s\"} %.9f\n", kPhaseNames[i],
+                     (double)m.phaseNs[i].load(memory_order_relaxed) / 1e9);
+    out += "# HELP abcu_phase_calls_total Times each phase ran (lines, for sampled phases).\n"
+           "# TYPE abcu_phase_calls_total counter\n";
+    for (size_t i = 0; i < (size_t)Phase::Count; ++i)
+        appendFormat(out, "abcu_phase_calls_total{phase=\"%s\"} %llu\n", kPhaseNames[i],
+                     (unsigned long long)m.phaseCalls[i].load(memory_order_relaxed));
+
+    out += "# HELP abcu_lookup_latency_seconds Query latency by operation.\n"
+           "# TYPE abcu_lookup_latency_seconds histogram\n";
+    for (const auto& op : kLatencyOps) {
+        const LatencyHistogram& h = m.*op.second;
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < LatencyHistogram::kBuckets; ++i) {
+            cumulative += h.bucketCount(i);
+            uint64_t limit = LatencyHistogram::bucketLimit(i);
+            bool powerOfTwo = (limit & (limit - 1)) == 0;
+            // Stop at 2^36 ns (~69 s); everything above lands in +Inf.
+            if (!powerOfTwo || limit < 1024 || limit > (1ull << 36)) continue;
+            appendFormat(out, "abcu_lookup_latency_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", op.first,
+                         (double)limit / 1e9, (unsigned long long)cumulative);
+        }
+        uint64_t n = h.count();
+        appendFormat(out, "abcu_lookup_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", op.first,
+                     (unsigned long long)n);
+        appendFormat(out, "abcu_lookup_latency_seconds_sum{op=\"%s\"} %.9f\n", op.first, (double)h.sum() / 1e9);
+        appendFormat(out, "abcu_lookup_latency_seconds_count{op=\"%s\"} %llu\n", op.first, (unsigned long long)n);
+    }
+
+    if (catalog) {
+        IndexStats s = catalog->courses.indexStats();
+        appendFormat(out, "# TYPE abcu_index_entries gauge\nabcu_index_entries %zu\n", s.entries);
+        appendFormat(out, "# TYPE abcu_index_capacity gauge\nabcu_index_capacity %zu\n", s.capacity);
+        appendFormat(out, "# TYPE abcu_index_mean_probe gauge\nabcu_index_mean_probe %.6f\n", s.meanProbe);
+        appendFormat(out, "# TYPE abcu_index_max_probe gauge\nabcu_index_max_probe %zu\n", s.maxProbe);
+    }
+
+    struct Counter { const char* name; const atomic<uint64_t>& value; };
+    const Counter counters[] = {{"abcu_allocations_total", m.allocations},
+                                {"abcu_allocated_bytes_total", m.allocatedBytes},
+                                {"abcu_frees_total", m.frees},
+                                {"abcu_read_bytes_total", m.bytesRead},
+                                {"abcu_written_bytes_total", m.bytesWritten},
+                                {"abcu_requests_total", m.requests},
+                                {"abcu_render_cache_hits_total", m.renderHits},
+                                {"abcu_render_cache_misses_total", m.renderMisses}};
+    for (const Counter& c : counters)
+        appendFormat(out, "# TYPE %s counter\n%s %llu\n", c.name, c.name,
+                     (unsigned long long)c.value.load(memory_order_relaxed));
+}
+#endif
+
+// Writes the --stats report to stderr.
+static void printStats(const Catalog* catalog) {
+#if ABCU_METRICS
+    string out;
+    appendStatsText(out, catalog);
+    cerr << out;
+#else
+    (void)catalog;
+    cerr << "Note: instrumentation is compiled out; build without NDEBUG or with -DABCU_METRICS=1 for --stats.\n";
+#endif
+}
+
+// -----------------------------------------------------------------------------
+// Profiling (--profile)
 // -----------------------------------------------------------------------------
-struct Course {
-    string number;                 // normalized course code (e.g. "CSCI200")
-    string title;                  // descriptive course name
-    vector<string> prereqNumbers;  // list of prerequisite course IDs
+// --profile OUT records every menu operation, the startup load and the
+// batch modes as one Chrome trace event each (chrome://tracing, Perfetto,
+// or any JSON reader) and writes OUT on exit. An event carries wall and CPU
+// time, hardware counters and heap allocations, and the trace records the
+// build's index layout, so runs of different builds on the same input
+// compare side by side. Wall time includes waiting at a prompt; CPU time
+// and the counters do not.
+
+// Hardware counters for this process, including threads it starts later,
+// through perf_event_open. A counter that cannot be opened (no PMU, a
+// container, kernel.perf_event_paranoid) is left out of the trace, as are
+// all of them off Linux.
+class PerfCounters {
+public:
+    static const size_t kCount = 4;
+
+    PerfCounters() {
+        for (int& fd : fds_) fd = -1;
+#ifdef __linux__
+        static const uint64_t kConfigs[kCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                   PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (size_t i = 0; i < kCount; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof attr;
+            attr.config = kConfigs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = 1; // a thread's counts join ours when it exits
+            fds_[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        }
+#endif
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fds_)
+            if (fd >= 0) close(fd);
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    static const char* name(size_t i) {
+        static const char* const kNames[kCount] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+        return kNames[i];
+    }
+    bool available(size_t i) const { return fds_[i] >= 0; }
+    uint64_t read(size_t i) const {
+        uint64_t v = 0;
+#ifdef __linux__
+        if (fds_[i] >= 0 && ::read(fds_[i], &v, sizeof v) != (ssize_t)sizeof v) v = 0;
+#endif
+        return v;
+    }
+
+private:
+    int fds_[kCount];
 };
 
-// hash table lookup for O(1) avg insert/search
-using CourseTable = unordered_map<string, Course>;
+struct ProfileSample {
+    uint64_t wallNs = 0;
+    uint64_t cpuNs = 0; // all threads of the process
+    uint64_t counters[PerfCounters::kCount] = {};
+    uint64_t allocations = 0, allocatedBytes = 0;
+};
 
-struct ProgramState {
-    bool loaded = false;
-    CourseTable courses;
-    vector<string> sortedKeys; // cached for consistent alphanumeric output
+class Profiler {
+public:
+    explicit Profiler(string path) : path_(std::move(path)), origin_(wallNs()) {}
+
+    ProfileSample sample() const {
+        ProfileSample s;
+        s.wallNs = wallNs();
+        s.cpuNs = (uint64_t)((double)clock() * 1e9 / CLOCKS_PER_SEC);
+        for (size_t i = 0; i < PerfCounters::kCount; ++i) s.counters[i] = perf_.read(i);
+#if ABCU_METRICS
+        s.allocations = metrics().allocations.load(memory_order_relaxed);
+        s.allocatedBytes = metrics().allocatedBytes.load(memory_order_relaxed);
+#endif
+        return s;
+    }
+
+    // Adds a complete event for an operation that ran from `start` until now.
+    void record(const char* name, const ProfileSample& start) {
+        ProfileSample end = sample();
+        events_.append(events_.empty() ? "\n" : ",\n");
+        events_.append("{\"name\":");
+        appendJsonString(events_, name);
+        events_.append(",\"cat\":\"operation\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":");
+        appendMicros(events_, start.wallNs - origin_);
+        events_.append(",\"dur\":");
+        appendMicros(events_, end.wallNs - start.wallNs);
+        events_.append(",\"args\":{\"cpu_us\":");
+        appendMicros(events_, end.cpuNs - start.cpuNs);
+        for (size_t i = 0; i < PerfCounters::kCount; ++i)
+            if (perf_.available(i))
+                events_.append(",\"").append(PerfCounters::name(i)).append("\":")
+                    .append(to_string(end.counters[i] - start.counters[i]));
+#if ABCU_METRICS
+        events_.append(",\"allocations\":").append(to_string(end.allocations - start.allocations));
+        events_.append(",\"allocated_bytes\":").append(to_string(end.allocatedBytes - start.allocatedBytes));
+#endif
+        events_.append("}}");
+    }
+
+    // Prints the error and returns false if the trace cannot be written.
+    bool write() const {
+        string out = "{\"traceEvents\":[";
+        out.append(events_).append("\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"index\":\"");
+#ifdef ABCU_STD_COURSE_INDEX
+        out.append("std");
+#else
+        out.append("flat");
+#endif
+        out.append("\",\"code_format\":\"").append(to_string(ABCU_CODE_LETTERS)).push_back('x');
+        out.append(to_string(ABCU_CODE_DIGITS)).append("\",\"metrics\":").append(ABCU_METRICS ? "true" : "false");
+        out.append(",\"hardware_counters\":");
+        size_t open = 0;
+        for (size_t i = 0; i < PerfCounters::kCount; ++i) open += perf_.available(i);
+        out.append(to_string(open)).append("}}\n");
+        ofstream os(path_, ios::binary);
+        os << out;
+        if (!os.flush()) {
+            cerr << "Error: could not write \"" << path_ << "\".\n";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static uint64_t wallNs() {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+    static void appendMicros(string& out, uint64_t ns) {
+        out.append(to_string(ns / 1000)).push_back('.');
+        string frac = to_string(ns % 1000);
+        out.append(3 - frac.size(), '0').append(frac);
+    }
+
+    string path_;
+    uint64_t origin_;
+    PerfCounters perf_;
+    string events_;
+};
+
+// Records its lifetime as one event; does nothing without a profiler.
+class ProfileScope {
+public:
+    // a null name records nothing, for actions not worth an event
+    ProfileScope(Profiler* profiler, const char* name) : profiler_(name ? profiler : nullptr), name_(name) {
+        if (profiler_) start_ = profiler_->sample();
+    }
+    ~ProfileScope() { finish(); }
+    // record now rather than at scope exit, e.g. just before the trace is written
+    void finish() {
+        if (profiler_) profiler_->record(name_, start_);
+        profiler_ = nullptr;
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* profiler_;
+    const char* name_;
+    ProfileSample start_;
 };
 
 // -----------------------------------------------------------------------------
-// Utility Helpers
+// Server mode (--serve)
 // -----------------------------------------------------------------------------
+// A small HTTP/1.1 front end over the published catalog for the advising
+// portal, so lookups no longer pay for a process start and catalog load.
+//   GET /course/ID          Option 3 output
+//   GET /prereqs/ID         Option 4 output
+//   GET /dependents/ID      Option 10 output
+//   GET /courses            Option 2 output
+//   GET /search?q=TEXT      Option 7 output (&limit=N, default 10)
+//   GET /scan?q=QUERY       --scan output
+//   GET /healthz            "ok" once a catalog is loaded
+// Each takes ?format=text (default) or json; /courses also takes tsv. With
+// --campus, ?campus=NAME picks the campus (default: the active one).
+// Every worker runs its own epoll loop over the shared non-blocking listen
+// socket (EPOLLEXCLUSIVE wakes one worker per connection) and keeps the
+// connections it accepts, so no request ever crosses threads. Keep-alive and
+// pipelined requests are supported; request bodies are skipped.
+struct ServeOptions {
+    string address = "127.0.0.1";
+    uint16_t port = 0;
+    unsigned workers = 0;  // 0 = one per hardware thread
+};
 
-// trim helpers
-static inline string ltrim(string s) {
-    size_t i = 0;
-    while (i < s.size() && isspace((unsigned char)s[i])) ++i;
-    return s.substr(i);
+static void renderCourseJson(const CourseTable& table, CourseId id, string& out) {
+    out.append("{\"id\":");
+    appendJsonString(out, table.number(id));
+    out.append(",\"title\":");
+    appendJsonString(out, table.title(id));
+    out.append(",\"prerequisites\":[");
+    Span<CourseId> prereqs = table.prereqs(id);
+    for (size_t i = 0; i < prereqs.size(); ++i) {
+        CourseId pid = prereqs[i];
+        out.append(i ? ",{\"id\":" : "{\"id\":");
+        appendJsonString(out, table.number(pid));
+        out.append(",\"title\":");
+        if (table.isDefined(pid)) appendJsonString(out, table.title(pid));
+        else out.append("null");
+        out.push_back('}');
+    }
+    out.append("]}\n");
+}
+
+static void renderAllPrerequisitesJson(const Catalog& catalog, CourseId id, string& out) {
+    const CourseTable& table = catalog.courses;
+    out.append("{\"id\":");
+    appendJsonString(out, table.number(id));
+    out.append(",\"title\":");
+    appendJsonString(out, table.title(id));
+    out.append(",\"prerequisites\":[");
+    Span<PrereqGraph::Entry> all = catalog.prereqGraph().closure(id);
+    for (size_t i = 0; i < all.size(); ++i) {
+        CourseId pid = all[i].id;
+        out.append(i ? ",{\"id\":" : "{\"id\":");
+        appendJsonString(out, table.number(pid));
+        out.append(",\"title\":");
+        if (table.isDefined(pid)) appendJsonString(out, table.title(pid));
+        else out.append("null");
+        out.append(",\"depth\":").append(to_string(all[i].depth)).push_back('}');
+    }
+    out.append("]}\n");
 }
-static inline string rtrim(string s) {
-    if (s.empty()) return s;
-    size_t i = s.size() - 1;
-    while (i < s.size() && isspace((unsigned char)s[i])) {
-        if (i == 0) return "";
-        --i;
+
+static void renderDependentsJson(const Catalog& catalog, CourseId id, string& out) {
+    const CourseTable& table = catalog.courses;
+    out.append("{\"id\":");
+    appendJsonString(out, table.number(id));
+    out.append(",\"title\":");
+    appendJsonString(out, table.title(id));
+    out.append(",\"dependents\":[");
+    vector<PrereqGraph::Entry> all;
+    catalog.prereqGraph().dependentClosure(id, all);
+    for (size_t i = 0; i < all.size(); ++i) {
+        out.append(i ? ",{\"id\":" : "{\"id\":");
+        appendJsonString(out, table.number(all[i].id));
+        out.append(",\"title\":");
+        appendJsonString(out, table.title(all[i].id));
+        out.append(",\"depth\":").append(to_string(all[i].depth)).push_back('}');
     }
-    return s.substr(0, i + 1);
+    out.append("]}\n");
 }
-static inline string trim(string s) { return rtrim(ltrim(std::move(s))); }
 
-// Normalize course IDs → uppercase, strip spaces/dashes/underscores.
-// Accepts input like "cs-200" or "  cs 200 ".
-static string normalizeCourseId(string s) {
-    string out;
-    for (char ch : s) {
-        if (isspace((unsigned char)ch) || ch == '-' || ch == '_' || ch == ',') continue;
-        out.push_back((char)toupper((unsigned char)ch));
+// Decodes %XX and '+' in a path segment or query value.
+static void urlDecode(string_view s, string& out) {
+    auto hexValue = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        c = (char)tolower((unsigned char)c);
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    };
+    out.clear();
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0) {
+            out.push_back((char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2])));
+            i += 2;
+        } else out.push_back(s[i] == '+' ? ' ' : s[i]);
     }
-    return trim(out);
 }
 
-// Minimal quote-aware CSV parser. Handles titles with commas like:
-// "CSCI200","Data Structures, with Labs",CSCI100
-static vector<string> splitCSV(const string& line) {
-    vector<string> out;
-    string cur;
-    bool inQuotes = false;
-    for (size_t i = 0; i < line.size(); ++i) {
-        char ch = line[i];
-        if (ch == '"') {
-            // handle escaped quotes
-            if (inQuotes && i + 1 < line.size() && line[i + 1] == '"') {
-                cur.push_back('"');
-                ++i;
-            } else {
-                inQuotes = !inQuotes;
+static string_view queryParam(string_view query, string_view name) {
+    for (size_t pos = 0; pos < query.size();) {
+        size_t amp = min(query.find('&', pos), query.size());
+        string_view kv = query.substr(pos, amp - pos);
+        pos = amp + 1;
+        size_t eq = kv.find('=');
+        if (kv.substr(0, eq) == name) return eq == string_view::npos ? string_view() : kv.substr(eq + 1);
+    }
+    return string_view();
+}
+
+static bool equalsIgnoreCase(string_view a, string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    return true;
+}
+
+struct HttpResponse {
+    int status = 200;
+    const char* contentType = "text/plain; charset=utf-8";
+    string body;
+};
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Content Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 503: return "Service Unavailable";
+        default: return "Error";
+    }
+}
+
+// Routes one request against `catalog` (null before the first load), or
+// against one of `campuses` if it names one with ?campus=.
+static void handleRequest(const Catalog* catalog, const vector<unique_ptr<Campus>>& campuses, string_view method,
+                          string_view target, HttpResponse& res, string& scratch) {
+    auto fail = [&](int status, string_view msg) {
+        res.status = status;
+        res.contentType = "text/plain; charset=utf-8";
+        res.body.assign(msg).push_back('\n');
+    };
+    ABCU_COUNT(requests, 1);
+    if (method != "GET" && method != "HEAD") return fail(405, "Only GET is supported.");
+
+    size_t qmark = target.find('?');
+    string_view path = target.substr(0, qmark);
+    string_view query = qmark == string_view::npos ? string_view() : target.substr(qmark + 1);
+    string_view format = queryParam(query, "format");
+    bool json = format == "json";
+    if (!format.empty() && !json && format != "text" && !(format == "tsv" && (path == "/courses" || path == "/scan")))
+        return fail(400, "Unknown format.");
+    shared_ptr<const Catalog> campusCatalog;
+    string_view campus = queryParam(query, "campus");
+    if (!campus.empty()) {
+        urlDecode(campus, scratch);
+        const Campus* c = findCampus(campuses, scratch);
+        if (!c) return fail(404, "Unknown campus.");
+        campusCatalog = c->catalog.load();
+        catalog = campusCatalog.get();
+    }
+    if (path == "/metrics") {
+#if ABCU_METRICS
+        res.contentType = "text/plain; version=0.0.4";
+        appendPrometheus(res.body, catalog);
+        return;
+#else
+        return fail(404, "Metrics are compiled out.");
+#endif
+    }
+    if (!catalog) return fail(503, "No catalog loaded.");
+
+    if (path == "/healthz") return fail(200, "ok");
+    if (path == "/search") {
+        ABCU_TIME_LATENCY(search);
+        urlDecode(queryParam(query, "q"), scratch);
+        size_t limit = kSearchResults;
+        string_view limitText = queryParam(query, "limit");
+        if (!limitText.empty()) limit = min<size_t>(strtoul(string(limitText).c_str(), nullptr, 10), 1000);
+        vector<SearchIndex::Hit> hits;
+        catalog->search().search(scratch, limit, hits);
+        const CourseTable& table = catalog->courses;
+        if (json) {
+            res.contentType = "application/json";
+            res.body.push_back('[');
+            for (size_t i = 0; i < hits.size(); ++i) {
+                res.body.append(i ? ",{\"id\":" : "{\"id\":");
+                appendJsonString(res.body, table.number(hits[i].id));
+                res.body.append(",\"title\":");
+                appendJsonString(res.body, table.title(hits[i].id));
+                res.body.append(",\"score\":").append(to_string(hits[i].score)).push_back('}');
             }
-        } else if (ch == ',' && !inQuotes) {
-            out.push_back(trim(cur));
-            cur.clear();
+            res.body.append("]\n");
         } else {
-            cur.push_back(ch);
+            for (const SearchIndex::Hit& h : hits)
+                res.body.append(table.number(h.id)).append(", ").append(table.title(h.id)).push_back('\n');
         }
+        return;
     }
-    out.push_back(trim(cur));
-    return out;
+    if (path == "/courses") {
+        ListFormat lf = json ? ListFormat::Json : format == "tsv" ? ListFormat::Tsv : ListFormat::Text;
+        res.contentType = json ? "application/json" : format == "tsv" ? "text/tab-separated-values" : res.contentType;
+        appendCourseList(*catalog, lf, res.body, [] {});
+        return;
+    }
+    if (path == "/scan") {
+        ScanQuery q;
+        urlDecode(queryParam(query, "q"), scratch);
+        if (!parseScanQuery(scratch, q)) return fail(400, "Unknown scan query.");
+        ListFormat lf = json ? ListFormat::Json : format == "tsv" ? ListFormat::Tsv : ListFormat::Text;
+        res.contentType = json ? "application/json" : format == "tsv" ? "text/tab-separated-values" : res.contentType;
+        appendScan(*catalog, q, lf, res.body);
+        return;
+    }
+
+    enum class Route { Course, Prereqs, Dependents } route;
+    size_t prefix;
+    if (path.substr(0, 8) == "/course/") route = Route::Course, prefix = 8;
+    else if (path.substr(0, 9) == "/prereqs/") route = Route::Prereqs, prefix = 9;
+    else if (path.substr(0, 12) == "/dependents/") route = Route::Dependents, prefix = 12;
+    else return fail(404, "Unknown path.");
+#if ABCU_METRICS
+    LatencyTimer timer(route == Route::Course    ? metrics().courseLookup
+                       : route == Route::Prereqs ? metrics().prereqLookup
+                                                 : metrics().dependentsLookup);
+#endif
+    urlDecode(path.substr(prefix), scratch);
+    CourseCode code = normalizeCourseId(scratch);
+    CourseId id = catalog->courses.find(code);
+    if (code.empty() || !catalog->courses.isDefined(id)) return fail(404, "Course not found.");
+
+    if (json) res.contentType = "application/json";
+    if (route == Route::Prereqs)
+        json ? renderAllPrerequisitesJson(*catalog, id, res.body) : renderAllPrerequisites(*catalog, id, res.body);
+    else if (route == Route::Dependents)
+        json ? renderDependentsJson(*catalog, id, res.body) : renderDependents(*catalog, id, res.body);
+    else if (json)
+        renderCached(catalog->courseJson, id, res.body, [&](string& o) { renderCourseJson(catalog->courses, id, o); });
+    else
+        renderCached(catalog->courseText, id, res.body, [&](string& o) { renderCourse(catalog->courses, id, o); });
 }
 
-static void printDivider() { cout << "----------------------------------------\n"; }
+#ifdef ABCU_HAVE_EPOLL
+class HttpServer {
+public:
+    static const size_t kMaxHeaderBytes = 16 * 1024;
+    static const size_t kMaxBodyBytes = 8 * 1024; // every endpoint is a GET; bodies are read and ignored
+    static const size_t kReadChunk = 16 * 1024;
 
-// -----------------------------------------------------------------------------
-// Option 1: Load File Data
-// -----------------------------------------------------------------------------
-static bool loadCoursesFromFile(const string& filename, ProgramState& state) {
-    ifstream in(filename);
-    if (!in) {
-        cerr << "Error: could not open \"" << filename << "\".\n";
-        return false;
+    HttpServer(const Published<Catalog>& catalog, const vector<unique_ptr<Campus>>& campuses, int listenFd,
+               int stopFd)
+        : catalog_(catalog), campuses_(campuses), listenFd_(listenFd), stopFd_(stopFd) {}
+
+    // One worker's event loop; returns once stopFd becomes readable.
+    void run() {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        if (ep < 0) {
+            cerr << "Error: epoll_create1 failed: " << strerror(errno) << ".\n";
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &listenFd_;
+        epoll_ctl(ep, EPOLL_CTL_ADD, listenFd_, &ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &stopFd_;
+        epoll_ctl(ep, EPOLL_CTL_ADD, stopFd_, &ev);
+
+        vector<epoll_event> events(256);
+        vector<unique_ptr<Connection>> conns; // indexed by fd
+        bool stopping = false;
+        while (!stopping) {
+            int n = epoll_wait(ep, events.data(), (int)events.size(), -1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) break;
+            // one catalog reference per wake-up, not per request
+            shared_ptr<const Catalog> catalog = catalog_.load();
+            for (int i = 0; i < n; ++i) {
+                void* tag = events[i].data.ptr;
+                if (tag == &stopFd_) stopping = true;
+                else if (tag == &listenFd_) acceptAll(ep, conns);
+                else {
+                    Connection* c = static_cast<Connection*>(tag);
+                    if (!serviceConnection(ep, *c, catalog.get(), events[i].events)) {
+                        close(c->fd);
+                        conns[c->fd].reset();
+                    }
+                }
+            }
+        }
+        for (auto& c : conns)
+            if (c) close(c->fd);
+        close(ep);
     }
 
-    CourseTable newTable;
-    string line;
-    size_t lineNum = 0;
+private:
+    struct Connection {
+        int fd = -1;
+        string in;
+        size_t inPos = 0;      // start of the next unparsed request
+        string out;
+        size_t outPos = 0;
+        bool peerClosed = false;
+        bool lastRequest = false;  // answered a Connection: close or an error
+        uint32_t events = EPOLLIN | EPOLLRDHUP;
+    };
 
-    while (getline(in, line)) {
-        ++lineNum;
-        line = trim(line);
-        if (line.empty()) continue;
+    void acceptAll(int ep, vector<unique_ptr<Connection>>& conns) {
+        while (true) {
+            int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;  // EAGAIN, or another worker took it
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+            if ((size_t)fd >= conns.size()) conns.resize(fd + 1);
+            conns[fd].reset(new Connection);
+            conns[fd]->fd = fd;
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = conns[fd].get();
+            if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                conns[fd].reset();
+            }
+        }
+    }
 
-        auto fields = splitCSV(line);
-        if (fields.size() < 2) {
-            cerr << "Warning: malformed line " << lineNum << ".\n";
-            continue;
+    // Returns false when the connection should be closed.
+    bool serviceConnection(int ep, Connection& c, const Catalog* catalog, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) return false;
+        if (events & EPOLLIN) {
+            char buf[kReadChunk];
+            while (true) {
+                ssize_t got = read(c.fd, buf, sizeof buf);
+                if (got > 0) c.in.append(buf, (size_t)got);
+                else if (got == 0) {
+                    c.peerClosed = true;
+                    break;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                else if (errno != EINTR) return false;
+            }
+            parseRequests(c, catalog);
         }
+        if (!flushOutput(c)) return false;
+        bool pending = c.outPos < c.out.size();
+        bool reading = !c.peerClosed && !c.lastRequest;
+        if (!pending && !reading) return false;
 
-        Course c;
-        c.number = normalizeCourseId(fields[0]);
-        c.title  = fields[1];
+        uint32_t want = (reading ? EPOLLIN | EPOLLRDHUP : 0u) | (pending ? EPOLLOUT : 0u);
+        if (want != c.events) {
+            epoll_event ev{};
+            ev.events = want;
+            ev.data.ptr = &c;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+            c.events = want;
+        }
+        return true;
+    }
+
+    // Answers every complete request in c.in, appending responses to c.out.
+    void parseRequests(Connection& c, const Catalog* catalog) {
+        while (!c.lastRequest) {
+            string_view pending = string_view(c.in).substr(c.inPos);
+            size_t end = pending.find("\r\n\r\n");
+            if (end == string_view::npos) {
+                if (pending.size() > kMaxHeaderBytes) respondError(c, 431);
+                break;
+            }
+            string_view head = pending.substr(0, end);
+            size_t lineEnd = min(head.find("\r\n"), head.size());
+            string_view requestLine = head.substr(0, lineEnd);
+
+            size_t sp1 = requestLine.find(' ');
+            size_t sp2 = sp1 == string_view::npos ? sp1 : requestLine.find(' ', sp1 + 1);
+            if (sp2 == string_view::npos) {
+                respondError(c, 400);
+                break;
+            }
+            string_view method = requestLine.substr(0, sp1);
+            string_view target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+            string_view version = requestLine.substr(sp2 + 1);
+
+            bool keepAlive = version == "HTTP/1.1";
+            size_t bodyBytes = 0;
+            bool badLength = false;
+            for (size_t pos = lineEnd + 2; pos < head.size();) {
+                size_t next = min(head.find("\r\n", pos), head.size());
+                string_view line = head.substr(pos, next - pos);
+                pos = next + 2;
+                size_t colon = line.find(':');
+                if (colon == string_view::npos) continue;
+                string_view name = trim(line.substr(0, colon)), value = trim(line.substr(colon + 1));
+                if (equalsIgnoreCase(name, "connection")) {
+                    if (equalsIgnoreCase(value, "close")) keepAlive = false;
+                    else if (equalsIgnoreCase(value, "keep-alive")) keepAlive = true;
+                } else if (equalsIgnoreCase(name, "content-length")) {
+                    string digits(value);
+                    char* stop = nullptr;
+                    errno = 0;
+                    unsigned long long n = strtoull(digits.c_str(), &stop, 10);
+                    badLength = digits.empty() || !isdigit((unsigned char)digits[0]) || *stop;
+                    bodyBytes = errno == ERANGE || n > kMaxBodyBytes ? kMaxBodyBytes + 1 : (size_t)n;
+                }
+            }
+            // refuse before buffering: the length comes straight from the client
+            if (badLength || bodyBytes > kMaxBodyBytes) {
+                respondError(c, badLength ? 400 : 413);
+                break;
+            }
+            if (pending.size() < end + 4 + bodyBytes) break; // body still arriving
+            c.inPos += end + 4 + bodyBytes;
 
-        for (size_t i = 2; i < fields.size(); ++i) {
-            string p = normalizeCourseId(fields[i]);
-            if (!p.empty()) c.prereqNumbers.push_back(p);
+            response_.status = 200;
+            response_.contentType = "text/plain; charset=utf-8";
+            response_.body.clear();
+            handleRequest(catalog, campuses_, method, target, response_, scratch_);
+            appendResponse(c, response_, method == "HEAD", keepAlive);
+            c.lastRequest = !keepAlive;
         }
+        // drop consumed bytes once in a while rather than on every request
+        if (c.inPos == c.in.size()) {
+            c.in.clear();
+            c.inPos = 0;
+        } else if (c.inPos > kReadChunk) {
+            c.in.erase(0, c.inPos);
+            c.inPos = 0;
+        }
+    }
 
-        if (!c.number.empty()) newTable[c.number] = std::move(c);
+    void respondError(Connection& c, int status) {
+        response_.status = status;
+        response_.contentType = "text/plain; charset=utf-8";
+        response_.body.assign(statusText(status)).push_back('\n');
+        appendResponse(c, response_, false, false);
+        c.lastRequest = true;
+        c.in.clear();
+        c.inPos = 0;
     }
 
-    // Replace the program state only after the entire file has been parsed successfully
-    state.courses.swap(newTable);
+    static void appendResponse(Connection& c, const HttpResponse& res, bool headOnly, bool keepAlive) {
+        string& out = c.out;
+        out.append("HTTP/1.1 ").append(to_string(res.status)).push_back(' ');
+        out.append(statusText(res.status)).append("\r\nContent-Type: ").append(res.contentType);
+        out.append("\r\nContent-Length: ").append(to_string(res.body.size()));
+        out.append(keepAlive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+        if (!headOnly) out.append(res.body);
+    }
 
-    // Store pre-sorted course numbers to avoid re-sorting each time the list is printed
-    state.sortedKeys.clear();
-    state.sortedKeys.reserve(state.courses.size());
-    for (auto& kv : state.courses) state.sortedKeys.push_back(kv.first);
-    sort(state.sortedKeys.begin(), state.sortedKeys.end());
-    state.loaded = true;
+    static bool flushOutput(Connection& c) {
+        while (c.outPos < c.out.size()) {
+            ssize_t sent = send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+            if (sent > 0) {
+                c.outPos += (size_t)sent;
+                ABCU_COUNT(bytesWritten, sent);
+            }
+            else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+            else if (sent < 0 && errno == EINTR) continue;
+            else return false;
+        }
+        c.out.clear();
+        c.outPos = 0;
+        return true;
+    }
 
-    cout << "Loaded " << state.courses.size() << " courses from \"" << filename << "\".\n";
-    return true;
+    const Published<Catalog>& catalog_;
+    const vector<unique_ptr<Campus>>& campuses_; // fixed while serving
+    int listenFd_;
+    int stopFd_;
+    HttpResponse response_;  // per worker, reused across requests
+    string scratch_;
+};
+
+static int openListenSocket(const ServeOptions& opt) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    if (inet_pton(AF_INET, opt.address.c_str(), &addr.sin_addr) != 1) {
+        cerr << "Error: bad listen address \"" << opt.address << "\".\n";
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        cerr << "Error: socket failed: " << strerror(errno) << ".\n";
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (::bind(fd, (sockaddr*)&addr, sizeof addr) < 0 || listen(fd, SOMAXCONN) < 0) {
+        cerr << "Error: could not listen on " << opt.address << ":" << opt.port << ": " << strerror(errno) << ".\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
 }
 
-// -----------------------------------------------------------------------------
-// Option 2: Print full course list (alphanumeric)
-// -----------------------------------------------------------------------------
-static void printCourseList(const ProgramState& state) {
-    if (!state.loaded) {
-        cout << "Please load the data first (Option 1).\n";
-        return;
+// Serves until SIGINT or SIGTERM. SIGHUP reloads changed rows (Option 6) and
+// publishes the result; requests already running finish on the old catalog.
+static int runServer(ProgramState& state, const ServeOptions& opt) {
+    // block the signals before any worker starts so only sigwait sees them
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &sigs, nullptr);
+
+    int listenFd = openListenSocket(opt);
+    if (listenFd < 0) return 1;
+    int stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    unsigned workers = opt.workers ? opt.workers : max(1u, thread::hardware_concurrency());
+    vector<unique_ptr<HttpServer>> servers;
+    vector<thread> pool;
+    for (unsigned i = 0; i < workers; ++i) {
+        servers.emplace_back(new HttpServer(state.catalog, state.campuses, listenFd, stopFd));
+        pool.emplace_back(&HttpServer::run, servers.back().get());
+    }
+    cerr << "Serving on " << opt.address << ":" << opt.port << " with " << workers << " workers.\n";
+
+    while (true) {
+        int sig = 0;
+        if (sigwait(&sigs, &sig) != 0) continue;
+        if (sig != SIGHUP) break;
+        reloadChanged(state);
     }
-    for (const string& id : state.sortedKeys)
-        cout << id << ", " << state.courses.at(id).title << '\n';
+
+    uint64_t one = 1;
+    if (write(stopFd, &one, sizeof one) < 0) {} // level-triggered: wakes every worker
+    for (thread& t : pool) t.join();
+    close(stopFd);
+    close(listenFd);
+    return 0;
+}
+#else
+static int runServer(ProgramState&, const ServeOptions&) {
+    cerr << "Error: --serve needs Linux (epoll).\n";
+    return 1;
 }
+#endif
 
 // -----------------------------------------------------------------------------
-// Option 3: Print single course + prerequisites
+// Synthetic catalogs (--generate) and benchmarks (--bench)
 // -----------------------------------------------------------------------------
-static void printSingleCourse(const ProgramState& state) {
-    if (!state.loaded) {
-        cout << "Please load the data first (Option 1).\n";
-        return;
+struct GeneratorOptions {
+    size_t rows = 100000;
+    unsigned titleWords = 4;   // average words per title
+    double quoteRate = 0.1;    // share of titles with a comma, hence quoted
+    unsigned fanout = 3;       // at most this many prerequisites per course
+    unsigned depth = 8;        // prerequisite chains are at most this long
+    uint64_t seed = 1;
+};
+
+// splitmix64: the same stream on every platform, unlike <random>'s
+// distributions, so a seed names one catalog.
+class BenchRng {
+public:
+    explicit BenchRng(uint64_t seed) : s_(seed) {}
+    uint64_t next() {
+        uint64_t z = (s_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
     }
+    size_t below(size_t n) { return n ? (size_t)(next() % n) : 0; }
+    bool chance(double p) { return (double)(next() >> 11) * 0x1.0p-53 < p; }
 
-    cout << "What course do you want to know about? ";
-    string query;
-    getline(cin, query);
-    query = normalizeCourseId(query);
+private:
+    uint64_t s_;
+};
 
-    if (query.empty()) {
-        cout << "No course entered.\n";
-        return;
+// Writes a CSV catalog. Courses are split into `depth` levels and only take
+// prerequisites from lower levels, so the graph is acyclic with chains of at
+// most `depth` courses. Rows come out shuffled, as in a hand-edited file.
+static void generateCatalog(const GeneratorOptions& g, ostream& os) {
+    static const char* const kWords[] = {
+        "Introduction", "Advanced", "Data", "Structures", "Algorithms", "Systems", "Operating", "Programming",
+        "Software", "Engineering", "Discrete", "Mathematics", "Calculus", "Linear", "Algebra", "Physics",
+        "Chemistry", "Biology", "Networks", "Databases", "Security", "Theory", "Computation", "Machine",
+        "Learning", "Graphics", "Compilers", "Design", "Analysis", "Statistics", "Probability", "History",
+        "Literature", "Writing", "Economics", "Finance", "Ethics", "Philosophy", "Psychology", "Studio",
+        "Laboratory", "Seminar", "Topics", "Applied", "Numerical", "Methods", "Parallel", "Distributed",
+        "Mobile", "Web", "Human", "Interaction", "Robotics", "Vision", "Language", "Processing"};
+    const size_t nWords = sizeof kWords / sizeof kWords[0];
+    BenchRng rng(g.seed);
+
+    // codes: four-letter departments of up to 900 courses each
+    size_t rows = g.rows, depth = max<size_t>(1, g.depth);
+    vector<string> codes(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        size_t dept = i / 900;
+        string code(4, 'A');
+        for (size_t k = 4, d = dept; k-- > 0; d /= 26) code[k] = (char)('A' + d % 26);
+        codes[i] = code + to_string(100 + i % 900);
     }
+    vector<size_t> order(rows);
+    for (size_t i = 0; i < rows; ++i) order[i] = i;
+    for (size_t i = rows; i > 1; --i) swap(order[i - 1], order[rng.below(i)]);
 
-    auto it = state.courses.find(query);
-    if (it == state.courses.end()) {
-        cout << "Course not found.\n";
-        return;
+    OutputBuffer out(os);
+    string& buf = out.str();
+    vector<size_t> picked;
+    for (size_t row : order) {
+        buf.append(codes[row]).push_back(',');
+        size_t words = max<size_t>(1, g.titleWords / 2 + rng.below(g.titleWords + 1));
+        bool quoted = rng.chance(g.quoteRate);
+        if (quoted) buf.push_back('"');
+        for (size_t w = 0; w < words; ++w) {
+            if (w) buf.append(quoted && w == 1 ? ", " : " ");
+            buf.append(kWords[rng.below(nWords)]);
+        }
+        if (quoted) buf.push_back('"');
+        // level = row's slice of the catalog; prerequisites come from below
+        size_t level = row * depth / max<size_t>(1, rows);
+        size_t levelStart = level * rows / depth;
+        size_t prereqs = level ? min(rng.below(g.fanout + 1), levelStart) : 0;
+        picked.clear();
+        while (picked.size() < prereqs) {
+            size_t p = rng.below(levelStart);
+            if (find(picked.begin(), picked.end(), p) != picked.end()) continue;
+            picked.push_back(p);
+            buf.append(",").append(codes[p]);
+        }
+        buf.push_back('\n');
+        out.maybeFlush();
     }
+}
 
-    const Course& c = it->second;
-    cout << c.number << ", " << c.title << '\n';
+struct BenchOptions {
+    string filter;         // run only benchmarks whose name contains this
+    double minSeconds = 0.5;
+};
 
-    if (c.prereqNumbers.empty()) {
-        cout << "Prerequisites: None\n";
-        return;
+struct BenchResult {
+    string name;
+    size_t iterations;
+    double nsPerOp;
+    double itemsPerOp;     // records, lookups, bytes... per operation
+    const char* itemUnit;
+};
+
+static volatile size_t benchSink; // results land here so calls are not optimised away
+
+// Runs fn() in doubling batches until a batch takes at least minSeconds, like
+// Google Benchmark, and reports the time per call.
+template <typename Fn>
+static bool runBench(const BenchOptions& opt, const char* name, double items, const char* unit, Fn fn,
+                     vector<BenchResult>& results) {
+    if (!opt.filter.empty() && string_view(name).find(opt.filter) == string_view::npos) return false;
+    using Clock = chrono::steady_clock;
+    for (size_t iters = 1;; iters *= 2) {
+        Clock::time_point t0 = Clock::now();
+        for (size_t i = 0; i < iters; ++i) benchSink += fn();
+        double secs = chrono::duration<double>(Clock::now() - t0).count();
+        if (secs >= opt.minSeconds || iters >= (size_t(1) << 40)) {
+            results.push_back({name, iters, secs * 1e9 / (double)iters, items, unit});
+            return true;
+        }
     }
+}
 
-    cout << "Prerequisites: ";
-    for (size_t i = 0; i < c.prereqNumbers.size(); ++i) {
-        const string& pid = c.prereqNumbers[i];
-        auto p = state.courses.find(pid);
-        if (p != state.courses.end())
-            cout << p->second.number << " (" << p->second.title << ")";
-        else
-            cout << pid << " (missing)";
-        if (i + 1 < c.prereqNumbers.size()) cout << ", ";
+// Benchmarks the hot paths over `catalogFile`, or, without one, over a
+// freshly generated catalog in the temp directory.
+static int runBenchmarks(const BenchOptions& opt, const GeneratorOptions& gen, const LoadOptions& load,
+                         string catalogFile, ListFormat format) {
+    namespace fs = std::filesystem;
+    vector<string> cleanup;
+    if (catalogFile.empty()) {
+        catalogFile = (fs::temp_directory_path() / ("abcu-bench-" + to_string(gen.seed) + ".csv")).string();
+        ofstream os(catalogFile, ios::binary);
+        generateCatalog(gen, os);
+        if (!os) {
+            cerr << "Error: could not write \"" << catalogFile << "\".\n";
+            return 1;
+        }
+        cleanup.push_back(catalogFile);
+    }
+    MappedFile file(catalogFile);
+    if (!file.ok() || isSnapshot(file.bytes())) {
+        cerr << "Error: --bench needs a CSV catalog (\"" << catalogFile << "\").\n";
+        return 1;
+    }
+
+    // loads repeat many times: keep their warnings out of the report
+    streambuf* err = cerr.rdbuf(nullptr);
+    ProgramState state;
+    state.loadOptions = load;
+    state.loadOptions.quiet = true;
+    bool loaded = loadCoursesFromFile(catalogFile, state);
+    cerr.rdbuf(err);
+    cerr.clear();
+    if (!loaded) return 1;
+    shared_ptr<const Catalog> catalog = state.catalog.load();
+    const CourseTable& table = catalog->courses;
+
+    vector<string_view> records;
+    forEachRecord(file.bytes(), 1, [&](string_view rec, size_t) { if (!trim(rec).empty()) records.push_back(rec); });
+    vector<CsvField> fields;
+    vector<string_view> codeFields;
+    for (string_view rec : records) {
+        splitCSV(rec, fields);
+        for (size_t i = 0; i < fields.size(); ++i)
+            if (i != 1 && !fields[i].hasQuotes) codeFields.push_back(fields[i].raw);
+    }
+    // lookups: every fourth query misses
+    BenchRng rng(gen.seed);
+    vector<CourseCode> queries(4096);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        string_view code = table.number(catalog->sortedKeys[rng.below(catalog->sortedKeys.size())]);
+        queries[i] = normalizeCourseId(i % 4 == 3 ? string(code) + "X" : string(code));
+    }
+    string batch;
+    for (const CourseCode& q : queries) batch.append(q.view()).push_back('\n');
+
+    vector<BenchResult> results;
+    auto bench = [&](const char* name, double items, const char* unit, auto fn) {
+        if (runBench(opt, name, items, unit, fn, results)) cerr << "  " << name << " done\n";
+    };
+    string snapshot = (fs::temp_directory_path() / ("abcu-bench-" + to_string(gen.seed) + ".snap")).string();
+
+    bench("load/csv", (double)file.bytes().size(), "bytes", [&] {
+        streambuf* saved = cerr.rdbuf(nullptr);
+        ProgramState s;
+        s.loadOptions = state.loadOptions;
+        loadCoursesFromFile(catalogFile, s);
+        cerr.rdbuf(saved);
+        cerr.clear();
+        return s.catalog.load()->courses.size();
+    });
+    if ((opt.filter.empty() || string_view("load/snapshot").find(opt.filter) != string_view::npos) &&
+        saveSnapshot(*catalog, snapshot)) {
+        cleanup.push_back(snapshot);
+        bench("load/snapshot", (double)table.size(), "courses", [&] {
+            ProgramState s;
+            s.loadOptions = state.loadOptions;
+            loadCoursesFromFile(snapshot, s);
+            return s.catalog.load()->courses.size();
+        });
+    }
+    bench("parse/splitCSV", (double)records.size(), "records", [&] {
+        size_t n = 0;
+        for (string_view rec : records) {
+            splitCSV(rec, fields);
+            n += fields.size();
+        }
+        return n;
+    });
+    bench("parse/normalizeCourseId", (double)codeFields.size(), "codes", [&] {
+        size_t n = 0;
+        CourseCode code;
+        for (string_view f : codeFields) {
+            normalizeCourseId(f, code);
+            n += code.size();
+        }
+        return n;
+    });
+    vector<CourseId> unsorted(catalog->sortedKeys.begin(), catalog->sortedKeys.end()), sortBuf;
+    for (size_t i = unsorted.size(); i > 1; --i) swap(unsorted[i - 1], unsorted[rng.below(i)]);
+    unsigned sortThreads = load.threads ? load.threads : max(thread::hardware_concurrency(), 1u);
+    bench("sort/codes", (double)unsorted.size(), "keys", [&] {
+        sortBuf = unsorted;
+        sortByCode(table, sortBuf);
+        return (size_t)sortBuf[0];
+    });
+    bench("sort/codes-parallel", (double)unsorted.size(), "keys", [&] {
+        sortBuf = unsorted;
+        sortByCode(table, sortBuf, sortThreads);
+        return (size_t)sortBuf[0];
+    });
+    bench("sort/natural", (double)unsorted.size(), "keys", [&] {
+        CollationKeys keys;
+        buildNaturalKeys(table, keys);
+        sortBuf = unsorted;
+        sortByKey(sortBuf, 1, [&](CourseId id) { return keys.of(id); });
+        return (size_t)sortBuf[0];
+    });
+    string listBuf;
+    bench("list/sorted", (double)table.size(), "courses", [&] {
+        listBuf.clear();
+        appendCourseList(*catalog, format, listBuf, [] {});
+        return listBuf.size();
+    });
+    bench("scan/summary", (double)table.size(), "courses", [&] {
+        listBuf.clear();
+        appendScan(*catalog, ScanQuery(), format, listBuf);
+        return listBuf.size();
+    });
+    ScanQuery roots;
+    roots.kind = ScanKind::Roots;
+    bench("scan/roots", (double)table.size(), "courses", [&] {
+        listBuf.clear();
+        appendScan(*catalog, roots, format, listBuf);
+        return listBuf.size();
+    });
+    bench("lookup/single", (double)queries.size(), "lookups", [&] {
+        size_t n = 0;
+        for (const CourseCode& q : queries) n += table.isDefined(table.find(q));
+        return n;
+    });
+    // Option 3 traffic: nine in ten lookups go to 200 popular courses
+    vector<CourseId> shown(queries.size());
+    for (size_t i = 0; i < shown.size(); ++i)
+        shown[i] = catalog->sortedKeys[i % 10 ? rng.below(min<size_t>(200, table.size())) : rng.below(table.size())];
+    string rendered;
+    bench("render/course", (double)shown.size(), "courses", [&] {
+        rendered.clear();
+        for (CourseId id : shown) renderCourse(table, id, rendered);
+        return rendered.size();
+    });
+    bench("render/course-cached", (double)shown.size(), "courses", [&] {
+        rendered.clear();
+        for (CourseId id : shown)
+            renderCached(catalog->courseText, id, rendered, [&](string& o) { renderCourse(table, id, o); });
+        return rendered.size();
+    });
+    bench("lookup/batch", (double)queries.size(), "lookups", [&] {
+        istringstream in(batch);
+        ostringstream out;
+        runBatchQueries(*catalog, in, false, out);
+        return (size_t)out.tellp();
+    });
+    vector<SearchIndex::Hit> hits;
+    bench("search/prefix", (double)queries.size(), "queries", [&] {
+        size_t n = 0;
+        for (const CourseCode& q : queries) {
+            catalog->search().search(q.view().substr(0, 5), kSearchResults, hits);
+            n += hits.size();
+        }
+        return n;
+    });
+    bench("search/title", 4, "queries", [&] {
+        size_t n = 0;
+        for (string_view q : {"data struct", "machine learn", "intro prog", "operating systms"}) {
+            catalog->search().search(q, kSearchResults, hits);
+            n += hits.size();
+        }
+        return n;
+    });
+    for (const string& f : cleanup) fs::remove(f);
+
+    OutputBuffer out(cout);
+    string& buf = out.str();
+    char line[160];
+    if (format == ListFormat::Json) buf.push_back('[');
+    else buf.append(format == ListFormat::Tsv ? "name\titerations\tns_per_op\titems_per_sec\tunit\n"
+                                              : "benchmark                  iterations       ns/op      items/s\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        double perSec = r.itemsPerOp * 1e9 / r.nsPerOp;
+        if (format == ListFormat::Json) {
+            snprintf(line, sizeof line, "%s\n{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.1f,"
+                     "\"items_per_sec\":%.0f,\"unit\":\"%s\"}", i ? "," : "", r.name.c_str(), r.iterations,
+                     r.nsPerOp, perSec, r.itemUnit);
+        } else if (format == ListFormat::Tsv) {
+            snprintf(line, sizeof line, "%s\t%zu\t%.1f\t%.0f\t%s\n", r.name.c_str(), r.iterations, r.nsPerOp,
+                     perSec, r.itemUnit);
+        } else {
+            snprintf(line, sizeof line, "%-24s %12zu %11.0f %12.4g %s\n", r.name.c_str(), r.iterations,
+                     r.nsPerOp, perSec, r.itemUnit);
+        }
+        buf.append(line);
+    }
+    if (format == ListFormat::Json) buf.append("\n]\n");
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+// Self-test (--self-test)
+// -----------------------------------------------------------------------------
+// Regression checks for guarantees no output diff would show, such as
+// allocation counts. Prints one line per check and exits 1 if any failed.
+class SelfTest {
+public:
+    void check(const char* name, bool ok, const string& detail) {
+        cout << (ok ? "ok    " : "FAIL  ") << name << " (" << detail << ")\n";
+        failed_ += !ok;
+    }
+    void skip(const char* name, const char* why) { cout << "skip  " << name << " (" << why << ")\n"; }
+    int exitCode() const { return failed_ ? 1 : 0; }
+
+private:
+    size_t failed_ = 0;
+};
+
+// Prerequisite fields whose codes are already interned cost no allocation
+// (see parseCourseLine), so parsing a catalog a second time into the same
+// table only grows the arena and the prerequisite pool, a few times in all.
+static void testPrereqFieldsDoNotAllocate(SelfTest& t) {
+    const char* name = "prerequisite fields do not allocate";
+#if ABCU_METRICS
+    GeneratorOptions g;
+    g.rows = 20000;
+    g.fanout = 6;
+    ostringstream os;
+    generateCatalog(g, os);
+    string csv = os.str();
+    CourseTable table;
+    LineParser lp;
+    parseCourseBuffer(csv, 1, lp, table);
+    size_t fields = 0;
+    for (CourseId id = 0; id < table.idCount(); ++id) fields += table.prereqs(id).size();
+
+    uint64_t before = metrics().allocations.load(memory_order_relaxed);
+    parseCourseBuffer(csv, 1, lp, table);
+    uint64_t made = metrics().allocations.load(memory_order_relaxed) - before;
+    t.check(name, made * 1000 < fields,
+            to_string(made) + " allocations for " + to_string(fields) + " prerequisite fields");
+#else
+    t.skip(name, "instrumentation compiled out");
+#endif
+}
+
+// Codes may differ only in trailing NUL bytes (normalizeCourseId keeps
+// them), which tie at every depth of the radix sort's eight-byte keys.
+// Checked against std::sort on runs small and large enough to take the
+// comparison, radix and parallel paths.
+static void testSortCodesWithTrailingNuls(SelfTest& t) {
+    for (size_t fillers : {size_t(0), size_t(100), kParallelSortMin}) {
+        CourseTable table;
+        string code = "ABC100";
+        for (size_t k = 0; k < 20; ++k, code.push_back('\0')) table.intern(code);
+        for (size_t i = 0; i < fillers; ++i) table.intern("ABC100" + to_string(i));
+        vector<CourseId> ids(table.idCount()), expected;
+        for (CourseId id = 0; id < ids.size(); ++id) ids[id] = id;
+        expected = ids;
+        sort(expected.begin(), expected.end(), [&](CourseId a, CourseId b) { return table.number(a) < table.number(b); });
+        sortByCode(table, ids, 4);
+        t.check("sort codes differing in trailing NULs", ids == expected, to_string(ids.size()) + " codes");
+    }
+}
+
+// A quote inside an unquoted field is text; one left open to the end of the
+// input skips only its own record and is reported with the lines it took.
+static void testStrayQuotes(SelfTest& t) {
+    CourseTable table;
+    LineParser lp;
+    parseCourseBuffer("CSCI100,Intro\nbad\"line\nCSCI200,Data,CSCI100\nCSCI300,Title with a \" in it\n"
+                      "CSCI400,\"Open,CSCI300\nCSCI500,Five\n",
+                      1, lp, table);
+    bool ok = table.size() == 3 && table.title(table.find("CSCI300")) == "Title with a \" in it" &&
+              lp.skipped.malformed == vector<size_t>{2} &&
+              lp.skipped.unterminated == vector<pair<size_t, size_t>>{{5, 6}};
+    t.check("stray quotes skip only their own records", ok, to_string(table.size()) + " courses");
+}
+
+// What eviction is for: a crawler sweeps cold courses right after a load,
+// filling the cache, and keeps sweeping once normal traffic for ~200 intro
+// courses starts. The hot courses must end up cached anyway, and the cache
+// must stay within its capacity.
+static void testRenderCacheKeepsHotCourses(SelfTest& t) {
+    RenderCache cache;
+    BenchRng rng(1);
+    const CourseId kHot = 200, kCold = 20000;
+    string out;
+    auto show = [&](CourseId id) {
+        out.clear();
+        if (!cache.appendTo(id, out)) cache.insert(id, to_string(id));
+    };
+    for (CourseId cold = kHot; cold < kHot + kCold; ++cold) {
+        show(cold);
+        if (cold >= kHot + 2 * RenderCache::kDefaultEntries)
+            for (int i = 0; i < 4; ++i) show((CourseId)rng.below(kHot));
+    }
+    size_t hot = 0, cached = 0;
+    for (CourseId id = 0; id < kHot; ++id) {
+        out.clear();
+        hot += cache.appendTo(id, out) && out == to_string(id);
     }
-    cout << '\n';
+    for (CourseId id = kHot; id < kHot + kCold; ++id) cached += cache.appendTo(id, out);
+    t.check("render cache keeps hot courses through a cold sweep",
+            hot * 10 >= kHot * 9 && hot + cached <= RenderCache::kDefaultEntries,
+            to_string(hot) + " of " + to_string(kHot) + " hot courses cached, " + to_string(cached) + " cold");
+}
+
+static int runSelfTest() {
+    SelfTest t;
+    testPrereqFieldsDoNotAllocate(t);
+    testStrayQuotes(t);
+    testSortCodesWithTrailingNuls(t);
+    testRenderCacheKeepsHotCourses(t);
+    return t.exitCode();
 }
 
 // -----------------------------------------------------------------------------
@@ -219,17 +6297,316 @@ static void showMenu() {
     cout << "1. Load Data Structure\n"
          << "2. Print Course List\n"
          << "3. Print Course\n"
+         << "4. Print All Prerequisites\n"
+         << "5. Check Eligibility\n"
+         << "6. Reload Changed Rows\n"
+         << "7. Search Courses\n"
+         << "8. Plan Terms\n"
+         << "10. Show Dependents\n"
+         << "11. Switch Campus\n"
          << "9. Exit\n";
     printDivider();
     cout << "Enter choice: ";
 }
 
-int main() {
-    cout << "Welcome to the course planner.\n";
+struct Options {
+    LoadOptions load;
+    string catalog;    // --load: catalog to load before anything else
+    vector<CampusSource> campuses; // --campus NAME=FILE, instead of --load
+    string queryFile;  // --query-file: batch mode, "-" = stdin
+    string saveSnapshot; // --save-snapshot: write the loaded catalog and exit
+    bool sortBatch = false;
+    bool listOnly = false;  // --list: print the course list and exit
+    bool scan = false;      // --scan: run one scan query and exit
+    ScanQuery scanQuery;
+    ListFormat format = ListFormat::Text;
+    bool serve = false;     // --serve: answer HTTP queries until signalled
+    ServeOptions server;
+    string generate;        // --generate: write a synthetic catalog and exit
+    GeneratorOptions gen;
+    bool bench = false;     // --bench: run the benchmark suite and exit
+    BenchOptions benchOpt;
+    bool selfTest = false;  // --self-test: run the regression checks and exit
+    bool stats = false;     // --stats: print timings and counters to stderr on exit
+    string profileFile;     // --profile: write a trace of every operation here on exit
+    string planFile;        // --plan: plan every student in FILE ("-" = stdin) and exit
+    size_t termCap = kDefaultTermCap;
+    bool stream = false;    // --stream: --list without loading the catalog into memory
+    bool check = false;     // --check: validate the catalog in one streaming pass and exit
+    StreamOptions streamOpt;
+};
+
+static void printUsage(const char* argv0) {
+    cerr << "Usage: " << argv0 << " [options]\n"
+         << "  --load FILE           load a catalog (CSV or snapshot) at startup\n"
+         << "  --load-snapshot FILE  like --load, but FILE must be a binary snapshot\n"
+         << "  --campus NAME=FILE    load FILE as campus NAME; repeat for more (the first is active)\n"
+         << "  --save-snapshot OUT   write the --load catalog as a binary snapshot and exit\n"
+         << "  --query-file FILE     look up every course ID in FILE (\"-\" for stdin) and exit\n"
+         << "  --sort-batch          sort and de-duplicate the batch before lookup\n"
+         << "  --plan FILE           plan terms for each \"student,targets,completed\" row of FILE and exit\n"
+         << "  --term-cap N          courses per term for planning (default 4)\n"
+         << "  --list                print the course list and exit\n"
+         << "  --scan QUERY          print roots, leaves, missing, min-prereqs:N, fanout, fanin or summary and exit\n"
+         << "  --format FMT          course list format: text (default), tsv or json\n"
+         << "  --threads N           parser threads for large files (default: automatic)\n"
+         << "  --order ORDER         list order: code (default) or natural (CSCI200 before CSCI1000)\n"
+         << "  --serve [ADDR:]PORT   serve the --load catalog over HTTP (default ADDR 127.0.0.1)\n"
+         << "  --workers N           server event-loop threads (default: one per core)\n"
+         << "  --generate OUT        write a synthetic catalog to OUT (\"-\" for stdout) and exit\n"
+         << "  --rows N              ... with N courses (default 100000)\n"
+         << "  --title-words N       ... averaging N words per title (default 4)\n"
+         << "  --quote-rate P        ... quoting titles with commas at rate P (default 0.1)\n"
+         << "  --fanout N            ... with up to N prerequisites per course (default 3)\n"
+         << "  --depth N             ... and prerequisite chains up to N long (default 8)\n"
+         << "  --seed N              generator seed (default 1)\n"
+         << "  --bench [FILTER]      time the hot paths on --load FILE or a generated catalog\n"
+         << "  --bench-time SEC      minimum time per benchmark (default 0.5)\n"
+         << "  --self-test           run the built-in regression checks and exit\n"
+         << "  --stats               print phase timings, latencies and counters to stderr on exit\n"
+         << "  --profile OUT         write a Chrome trace of each operation (time, counters, allocations) to OUT\n"
+         << "  --stream              with --list: stream the CSV with bounded memory (external sort)\n"
+         << "  --check               report malformed rows, duplicates and undefined prerequisites and exit\n"
+         << "  --stream-memory MB    memory for --stream and --check sorting (default 256)\n"
+         << "  --temp-dir DIR        where --stream and --check spill sorted runs (default: system temp)\n";
+}
+
+// Accepts "--name value" and "--name=value".
+static bool parseArgs(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i], value;
+        size_t eq = arg.find('=');
+        bool hasValue = eq != string::npos;
+        if (hasValue) {
+            value = arg.substr(eq + 1);
+            arg.resize(eq);
+        }
+        auto needValue = [&]() {
+            if (hasValue) return true;
+            if (i + 1 >= argc) return false;
+            value = argv[++i];
+            return true;
+        };
+
+        if (arg == "--load" && needValue()) opt.catalog = value;
+        else if (arg == "--load-snapshot" && needValue()) {
+            opt.catalog = value;
+            opt.load.snapshotOnly = true;
+        }
+        else if (arg == "--campus" && needValue()) {
+            size_t sep = value.find('=');
+            if (sep == 0 || sep == string::npos || sep + 1 == value.size()) return false;
+            string name = value.substr(0, sep);
+            for (const CampusSource& c : opt.campuses)
+                if (c.name == name) return false;
+            opt.campuses.push_back({name, value.substr(sep + 1)});
+        }
+        else if (arg == "--save-snapshot" && needValue()) opt.saveSnapshot = value;
+        else if (arg == "--query-file" && needValue()) opt.queryFile = value;
+        else if (arg == "--sort-batch" && !hasValue) opt.sortBatch = true;
+        else if (arg == "--plan" && needValue()) opt.planFile = value;
+        else if (arg == "--term-cap" && needValue()) {
+            try { opt.termCap = stoul(value); } catch (...) { return false; }
+            if (opt.termCap == 0) return false;
+        }
+        else if (arg == "--list" && !hasValue) opt.listOnly = true;
+        else if (arg == "--scan" && needValue()) {
+            if (!parseScanQuery(value, opt.scanQuery)) return false;
+            opt.scan = true;
+        }
+        else if (arg == "--stats" && !hasValue) opt.stats = true;
+        else if (arg == "--profile" && needValue()) opt.profileFile = value;
+        else if (arg == "--stream" && !hasValue) opt.stream = true;
+        else if (arg == "--check" && !hasValue) opt.check = true;
+        else if (arg == "--stream-memory" && needValue()) {
+            try { opt.streamOpt.memoryBytes = (size_t)stoull(value) << 20; } catch (...) { return false; }
+            if (opt.streamOpt.memoryBytes == 0) return false;
+        }
+        else if (arg == "--temp-dir" && needValue()) opt.streamOpt.tempDir = value;
+        else if (arg == "--format" && needValue()) {
+            if (value == "text") opt.format = ListFormat::Text;
+            else if (value == "tsv") opt.format = ListFormat::Tsv;
+            else if (value == "json") opt.format = ListFormat::Json;
+            else return false;
+        }
+        else if (arg == "--order" && needValue()) {
+            if (value == "code") opt.load.order = CourseOrder::Code;
+            else if (value == "natural") opt.load.order = CourseOrder::Natural;
+            else return false;
+        }
+        else if (arg == "--threads" && needValue()) {
+            try { opt.load.threads = (unsigned)stoul(value); } catch (...) { return false; }
+        }
+        else if (arg == "--serve" && needValue()) {
+            size_t colon = value.rfind(':');
+            if (colon != string::npos) {
+                opt.server.address = value.substr(0, colon);
+                value.erase(0, colon + 1);
+            }
+            unsigned long port = 0;
+            try { port = stoul(value); } catch (...) { return false; }
+            if (port == 0 || port > 65535) return false;
+            opt.server.port = (uint16_t)port;
+            opt.serve = true;
+        }
+        else if (arg == "--workers" && needValue()) {
+            try { opt.server.workers = (unsigned)stoul(value); } catch (...) { return false; }
+        }
+        else if (arg == "--generate" && needValue()) opt.generate = value;
+        else if (arg == "--self-test" && !hasValue) opt.selfTest = true;
+        else if (arg == "--bench") {
+            opt.bench = true;
+            // optional filter: "--bench=load" or "--bench load"
+            if (hasValue) opt.benchOpt.filter = value;
+            else if (i + 1 < argc && argv[i + 1][0] != '-') opt.benchOpt.filter = argv[++i];
+        }
+        else if ((arg == "--rows" || arg == "--title-words" || arg == "--quote-rate" || arg == "--fanout" ||
+                  arg == "--depth" || arg == "--seed" || arg == "--bench-time") && needValue()) {
+            try {
+                if (arg == "--rows") opt.gen.rows = stoull(value);
+                else if (arg == "--title-words") opt.gen.titleWords = (unsigned)stoul(value);
+                else if (arg == "--quote-rate") opt.gen.quoteRate = stod(value);
+                else if (arg == "--fanout") opt.gen.fanout = (unsigned)stoul(value);
+                else if (arg == "--depth") opt.gen.depth = (unsigned)stoul(value);
+                else if (arg == "--seed") opt.gen.seed = stoull(value);
+                else opt.benchOpt.minSeconds = stod(value);
+            } catch (...) { return false; }
+        }
+        else return false;
+    }
+    return opt.catalog.empty() || opt.campuses.empty();
+}
+
+int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    if (!opt.generate.empty()) {
+        if (opt.generate == "-") {
+            generateCatalog(opt.gen, cout);
+            return 0;
+        }
+        ofstream os(opt.generate, ios::binary);
+        generateCatalog(opt.gen, os);
+        if (!os) {
+            cerr << "Error: could not write \"" << opt.generate << "\".\n";
+            return 1;
+        }
+        return 0;
+    }
+    if (opt.selfTest) return runSelfTest();
+    if (opt.bench) return runBenchmarks(opt.benchOpt, opt.gen, opt.load, opt.catalog, opt.format);
+
+    if (opt.stream || opt.check) {
+        if (opt.catalog.empty() || (opt.stream && !opt.check && !opt.listOnly)) {
+            cerr << "Error: --check and --stream --list need a CSV catalog (--load FILE).\n";
+            return 2;
+        }
+        int rc = opt.check ? runStreamCheck(opt.catalog, opt.streamOpt)
+                           : runStreamList(opt.catalog, opt.format, opt.load.order, opt.streamOpt);
+        if (opt.stats) {
+            cout.flush();
+            printStats(nullptr);
+        }
+        return rc;
+    }
+
     ProgramState state;
+    state.loadOptions = opt.load;
+    bool haveCatalog = !opt.catalog.empty() || !opt.campuses.empty();
+    auto loadStartup = [&] {
+        return opt.campuses.empty() ? loadCoursesFromFile(opt.catalog, state) : loadCampuses(opt.campuses, state);
+    };
+    unique_ptr<Profiler> profiler;
+    if (!opt.profileFile.empty()) profiler = make_unique<Profiler>(opt.profileFile);
+    Profiler* prof = profiler.get();
+
+    if (!opt.saveSnapshot.empty()) {
+        if (opt.catalog.empty()) {
+            cerr << "Error: --save-snapshot needs a catalog (--load FILE).\n";
+            return 2;
+        }
+        bool loaded;
+        {
+            ProfileScope scope(prof, "load");
+            loaded = loadCoursesFromFile(opt.catalog, state);
+        }
+        if (profiler) profiler->write();
+        if (!loaded) return 1;
+        return saveSnapshot(*state.catalog.load(), opt.saveSnapshot) ? 0 : 1;
+    }
+
+    if (opt.serve) {
+        if (!haveCatalog) {
+            cerr << "Error: --serve needs a catalog (--load FILE or --campus NAME=FILE).\n";
+            return 2;
+        }
+        bool loaded;
+        {
+            ProfileScope scope(prof, "load");
+            loaded = loadStartup();
+        }
+        if (profiler) profiler->write(); // the server's requests are covered by --stats and /metrics
+        if (!loaded) return 1;
+        int rc = runServer(state, opt.server);
+        if (opt.stats) printStats(state.catalog.load().get());
+        return rc;
+    }
+
+    if (!opt.queryFile.empty() || !opt.planFile.empty() || opt.listOnly || opt.scan) {
+        // keep stdout clean for the pipeline: only results go there
+        state.loadOptions.quiet = true;
+        if (!haveCatalog) {
+            cerr << "Error: --query-file, --plan, --list and --scan need a catalog (--load FILE or --campus NAME=FILE).\n";
+            return 2;
+        }
+        bool loaded;
+        {
+            ProfileScope scope(prof, "load");
+            loaded = loadStartup();
+        }
+        if (!loaded) {
+            if (profiler) profiler->write();
+            return 1;
+        }
+        shared_ptr<const Catalog> catalog = state.catalog.load();
+        const string& inputFile = opt.listOnly || opt.scan ? string() : opt.planFile.empty() ? opt.queryFile : opt.planFile;
+        ifstream file;
+        if (!inputFile.empty() && inputFile != "-") {
+            file.open(inputFile);
+            if (!file) {
+                cerr << "Error: could not open \"" << inputFile << "\".\n";
+                return 1;
+            }
+        }
+        istream& in = inputFile == "-" ? cin : file;
+        ProfileScope scope(prof, opt.listOnly ? "list" : opt.scan ? "scan" : !opt.planFile.empty() ? "plan" : "query-batch");
+        if (opt.listOnly) printCourseList(*catalog, opt.format);
+        else if (opt.scan) printScan(*catalog, opt.scanQuery, opt.format);
+        else if (!opt.planFile.empty()) runPlanBatch(*catalog, in, opt.termCap, sortThreads(opt.load), cout);
+        else runBatchQueries(*catalog, in, opt.sortBatch, cout);
+        if (opt.stats) {
+            cout.flush();
+            printStats(catalog.get());
+        }
+        if (profiler) {
+            scope.finish();
+            profiler->write();
+        }
+        return 0;
+    }
+
+    cout << "Welcome to the course planner.\n";
+    if (haveCatalog) {
+        ProfileScope scope(prof, "load");
+        loadStartup();
+    }
 
     while (true) {
         showMenu();
@@ -237,19 +6614,35 @@ int main() {
         if (!getline(cin, line)) break;
 
         int choice = -1;
-        try { choice = stoi(trim(line)); } catch (...) {}
+        try { choice = stoi(string(trim(line))); } catch (...) {}
+        // one trace event per menu action but Exit (9); the time includes waiting on its prompts
+        static const char* const kMenuOps[] = {"load", "list", "course", "prerequisites", "eligibility",
+                                                "reload", "search", "plan", nullptr, "dependents", "campus"};
+        ProfileScope scope(prof, choice >= 1 && choice <= 11 ? kMenuOps[choice - 1] : nullptr);
 
         if (choice == 1) {
             cout << "Enter the file name: ";
             string fname;
             getline(cin, fname);
-            if (!trim(fname).empty())
-                loadCoursesFromFile(trim(fname), state);
-            else
+            if (trim(fname).empty())
                 cout << "No file name entered.\n";
+            else if (loadCoursesFromFile(string(trim(fname)), state))
+                state.campuses.clear(); // a single file replaces any campuses
         }
-        else if (choice == 2) printCourseList(state);
-        else if (choice == 3) printSingleCourse(state);
+        else if ((choice >= 2 && choice <= 5) || (choice >= 7 && choice <= 8) || choice == 10) {
+            // hold one catalog for the whole action, even if a reload lands
+            shared_ptr<const Catalog> catalog = state.catalog.load();
+            if (!catalog) cout << "Please load the data first (Option 1).\n";
+            else if (choice == 2) printCourseList(*catalog, opt.format);
+            else if (choice == 3) printSingleCourse(*catalog);
+            else if (choice == 4) printAllPrerequisites(*catalog);
+            else if (choice == 5) checkEligibility(*catalog);
+            else if (choice == 7) searchCourses(*catalog);
+            else if (choice == 8) planTerms(*catalog, opt.termCap);
+            else printDependents(*catalog);
+        }
+        else if (choice == 6) reloadChanged(state);
+        else if (choice == 11) switchCampus(state);
         else if (choice == 9) {
             cout << "Thank you for using the Advising Assistance Program.\n";
             break;
@@ -257,5 +6650,10 @@ int main() {
         else
             cout << "That is not a valid option. Try again.\n";
     }
+    if (opt.stats) {
+        cout.flush();
+        printStats(state.catalog.load().get());
+    }
+    if (profiler) profiler->write();
     return 0;
 }